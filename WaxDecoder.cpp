@@ -45,6 +45,12 @@
 //-----------------------------------------------------------------------------
 // includes
 //-----------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
 #include "WaxDecoder.h"
 
 //-----------------------------------------------------------------------------
@@ -85,20 +91,58 @@ void GetBrowserInfo(ModuleInfo* pModuleInfo)
 //-----------------------------------------------------------------------------
 WaxDecoder::WaxDecoder()
 {
+	numDecks = DECK_COUNTS[0];
+	audioOutputs = AUDIO_OUTPUTS[0];
 	usineBlockSize = 0;
 	usineSmplRate = 0;
-	target_position = TARGET_UNKNOWN;
-	pitch = 0.;
+	activeState = NULL;
+	stagedState = NULL;
+	retiredState = NULL;
+	loaderPending = false;
+	loaderBusy = false;
+	loaderQuit = false;
+	calibrationSaved = false;
+	calibrationPending = false;
+	verifyFailures = 0;
+
+	for (int deck = 0; deck < MAX_DECKS; ++deck)
+	{
+		target_position[deck] = TARGET_UNKNOWN;
+		pitch[deck] = 0.;
+		heldTime[deck] = 0.;
+		loop_position[deck] = TARGET_UNKNOWN;
+		loop_pitch[deck] = 0.;
+	}
+	holdTime = 0;
+	smoothing = 0;
+
     lbxTimecodes = 0;
     lbxRpmSpeed = 0;
     lbxSoftPA = 0;
+    lbxLookup = 0;
+    lbxLock = 0;
+    lbxBitErrors = 0;
+    intHoldTime = 0;
+    lbxSmoothing = 0;
 };
 
 //-----------------------------------------------------------------------------
 WaxDecoder::~WaxDecoder()
 {
-	if (pcm != NULL)
-		delete [] pcm;
+	// once the loader is stopped, no other thread uses the decoders
+	if (loaderThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(loaderMutex);
+			loaderQuit = true;
+		}
+		loaderWake.notify_one();
+		loaderThread.join();
+	}
+
+	destroyState(activeState);
+	destroyState(stagedState.exchange(NULL));
+	destroyState(retiredState.exchange(NULL));
 }
 
 //-----------------------------------------------------------------------------
@@ -109,7 +153,10 @@ void WaxDecoder::onGetModuleInfo (MasterInfo* pMasterInfo, ModuleInfo* pModuleIn
 	pModuleInfo->ModuleType         = mtSimple;
 	pModuleInfo->BackColor          = sdkGetUsineColor(clAudioModuleColor);
 	pModuleInfo->Version			= MODULE_VERSION;
-	pModuleInfo->NumberOfParams     = 4;
+	pModuleInfo->NumberOfParams     = PARAMS_PER_DECK + FLAGS_PER_DECK;
+	pModuleInfo->QueryString		= "number of decks";
+	pModuleInfo->QueryListValues	= "\"1\",\"2\",\"4\",\"8\",\"1 with audio outputs\",\"2 with audio outputs\",\"4 with audio outputs\",\"8 with audio outputs\"";
+	pModuleInfo->QueryDefaultIdx	= 0;
 }
 
 
@@ -117,17 +164,49 @@ void WaxDecoder::onGetModuleInfo (MasterInfo* pMasterInfo, ModuleInfo* pModuleIn
 // query system and init methods
 //-----------------------------------------------------------------------------
 
-// query system not used
+//-----------------------------------------------------------------------------
+// the same parameters for each deck, the first deck as a single deck module
+int WaxDecoder::onGetNumberOfParams (int queryIndex)
+{
+	int params = PARAMS_PER_DECK + FLAGS_PER_DECK;
+
+	if (AUDIO_OUTPUTS[queryIndex])
+		params += AUDIO_OUTPUTS_PER_DECK;
+
+	return params * DECK_COUNTS[queryIndex];
+}
+
+//-----------------------------------------------------------------------------
+void WaxDecoder::onAfterQuery (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo, int queryIndex)
+{
+	numDecks = DECK_COUNTS[queryIndex];
+	audioOutputs = AUDIO_OUTPUTS[queryIndex];
+}
 
 //-----------------------------------------------------------------------------
 void WaxDecoder::onInitModule (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo) {
     
-	// init timecoder to 'serato_2a' timecode at 33 rpm without using a 'software' preamp
-	loadTimecoder(TC_NAMES[0], RPM_SPEED[0], SOFT_PREAMP[0]);
+	// lookup tables are built once then mapped from Usine temp folder
+	timecoder_set_cache_dir(sdkGetUsineTempPath());
+
+#ifdef _DEBUG
+	// check the decoding kernels against the reference decoder
+	timecoder_set_verify(true);
+#endif
+
+	// init timecoder to 'serato_2a' timecode at 33 rpm without using a 'software' preamp,
+	// built here for the first block, then by the loader thread when settings change
+	usineSmplRate = sdkGetSampleRate();
 
 	// usine block size
 	usineBlockSize = sdkGetBlocSize();
-	pcm = new signed short[usineBlockSize * 2];
+
+	DecoderSettings settings = {TC_NAMES[0], RPM_SPEED[0], SOFT_PREAMP[0], LUT_MODES[0], LOCK_MODES[0], TOLERANT[0], usineSmplRate, usineBlockSize};
+	activeState = buildState(settings);
+	if (activeState == NULL)
+		sdkTraceErrorChar("WaxDecoder : not enough memory for the decoders");
+
+	loaderThread = std::thread(&WaxDecoder::loaderLoop, this);
 }
 
 
@@ -136,33 +215,51 @@ void WaxDecoder::onInitModule (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo)
 //----------------------------------------------------------------------------
 
 //-----------------------------------------------------------------------------
-// parameters description
+// parameters description, PARAMS_PER_DECK for each deck then FLAGS_PER_DECK for each deck,
+// then AUDIO_OUTPUTS_PER_DECK for each deck if chosen
 void WaxDecoder::onGetParamInfo (int ParamIndex, TParamInfo* pParamInfo)
 {	
-	switch (ParamIndex) 
+	int flags = PARAMS_PER_DECK * numDecks;
+	int outputs = flags + FLAGS_PER_DECK * numDecks;
+	int deck = ParamIndex / PARAMS_PER_DECK;
+	int param = ParamIndex % PARAMS_PER_DECK;
+	AnsiCharPtr caption;
+
+	if (ParamIndex >= outputs)
+	{
+		deck = (ParamIndex - outputs) / AUDIO_OUTPUTS_PER_DECK;
+		param = PARAMS_PER_DECK + FLAGS_PER_DECK + (ParamIndex - outputs) % AUDIO_OUTPUTS_PER_DECK;
+	}
+	else if (ParamIndex >= flags)
+	{
+		deck = (ParamIndex - flags) / FLAGS_PER_DECK;
+		param = PARAMS_PER_DECK + (ParamIndex - flags) % FLAGS_PER_DECK;
+	}
+
+	switch (param) 
     {
     // audio in left
 	case 0:
+		caption						= "in L";
 		pParamInfo->ParamType		= ptAudio;
-		pParamInfo->Caption			= "in L";
 		pParamInfo->IsInput			= true;
 		pParamInfo->IsOutput		= false;
 		pParamInfo->ReadOnly		= false;
-		pParamInfo->EventPtr        = &audioInputTab[0];
+		pParamInfo->EventPtr        = &audioInputTab[deck][0];
 		break;
     // audio in right
 	case 1:
+		caption						= "in R";
 		pParamInfo->ParamType		= ptAudio;
-		pParamInfo->Caption			= "in R";
 		pParamInfo->IsInput			= true;
 		pParamInfo->IsOutput		= false;
 		pParamInfo->ReadOnly		= false;
-		pParamInfo->EventPtr        = &audioInputTab[1];
+		pParamInfo->EventPtr        = &audioInputTab[deck][1];
 		break;
 	// position output
 	case 2:
+		caption						= "position";
 		pParamInfo->ParamType		= ptDataField;
-		pParamInfo->Caption			= "position";
 		pParamInfo->IsInput			= false;
 		pParamInfo->IsOutput		= true;
 		pParamInfo->MinValue		= 0.0;
@@ -171,12 +268,12 @@ void WaxDecoder::onGetParamInfo (int ParamIndex, TParamInfo* pParamInfo)
 		pParamInfo->Symbol			= "s";
 		pParamInfo->Format			= "%g";
 		pParamInfo->ReadOnly		= true;
-		pParamInfo->EventPtr        = &dtfPositionOut;
+		pParamInfo->EventPtr        = &dtfPositionOut[deck];
 		break;
 	// pitch output
 	case 3:
+		caption						= "pitch";
 		pParamInfo->ParamType		= ptDataField;
-		pParamInfo->Caption			= "pitch";
 		pParamInfo->IsInput			= false;
 		pParamInfo->IsOutput		= true;
 		pParamInfo->MinValue		= -30.0;
@@ -185,12 +282,44 @@ void WaxDecoder::onGetParamInfo (int ParamIndex, TParamInfo* pParamInfo)
 		pParamInfo->Symbol			= "";
 		pParamInfo->Format			= "%g";
 		pParamInfo->ReadOnly		= true;
-		pParamInfo->EventPtr        = &dtfPitchOut;
+		pParamInfo->EventPtr        = &dtfPitchOut[deck];
+		break;
+	// position measured, or held through a gap
+	case 4:
+		caption						= "measured";
+		pParamInfo->ParamType		= ptRightLed;
+		pParamInfo->IsInput			= false;
+		pParamInfo->IsOutput		= true;
+		pParamInfo->ReadOnly		= true;
+		pParamInfo->EventPtr        = &ledMeasuredOut[deck];
 		break;
-	// default case
+	// position audio output, seconds after each sample or -1
+	case 5:
+		caption						= "audio pos";
+		pParamInfo->ParamType		= ptAudio;
+		pParamInfo->IsInput			= false;
+		pParamInfo->IsOutput		= true;
+		pParamInfo->ReadOnly		= true;
+		pParamInfo->EventPtr        = &audioOutputTab[deck][0];
+		break;
+	// pitch audio output
 	default:
+		caption						= "audio pitch";
+		pParamInfo->ParamType		= ptAudio;
+		pParamInfo->IsInput			= false;
+		pParamInfo->IsOutput		= true;
+		pParamInfo->ReadOnly		= true;
+		pParamInfo->EventPtr        = &audioOutputTab[deck][1];
 		break;
 	}
+
+	// numbered captions ('in L 1', 'pitch 2'...) as soon as there are several decks
+	if (numDecks > 1)
+	{
+		snprintf(captionTab[ParamIndex], sizeof(captionTab[ParamIndex]), "%s %d", caption, deck + 1);
+		caption = captionTab[ParamIndex];
+	}
+	pParamInfo->Caption				= caption;
 }
 
 
@@ -201,37 +330,102 @@ void WaxDecoder::onCallBack (UsineMessage *Message)
 
 //-----------------------------------------------------------------------------
 // populate properties tab with hardware settings (disc manufacturer, RPM speed and use of software phono preamp)
+// and the decoding options
 void WaxDecoder::onCreateSettings()
 {
 	sdkAddSettingLineCaption(PROPERTIES_TAB_NAME, "hardware settings");
 	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxTimecodes, "timecode", "\"serato_2a\",\"serato_2b\",\"serato_cd\",\"traktor_a\",\"traktor_b\",\"mixvibes_v2\",\"mixvibes_7inch\"");
 	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxRpmSpeed, "rpm", "\"33\",\"45\"");
 	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxSoftPA, "software phono preamp", "\"no\",\"yes\"");
+	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxLookup, "lookup table", "\"full\",\"compact\"");
+	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxLock, "lock", "\"safe\",\"early\"");
+	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxBitErrors, "bit errors", "\"strict\",\"tolerant\"");
+	sdkAddSettingLineInteger(PROPERTIES_TAB_NAME, &intHoldTime, "hold position", 0, 1000, scLinear, "ms", 0);
+	sdkAddSettingLineCombobox(PROPERTIES_TAB_NAME, &lbxSmoothing, "smoothing", "\"off\",\"tight\",\"medium\",\"smooth\"");
 }
 
 //-----------------------------------------------------------------------------
 void WaxDecoder::onSettingsHasChanged()
 {
-	loadTimecoder(TC_NAMES[lbxTimecodes], RPM_SPEED[lbxRpmSpeed], SOFT_PREAMP[lbxSoftPA]);
+	holdTime = intHoldTime;
+	smoothing = lbxSmoothing;
+
+	loadTimecoder(TC_NAMES[lbxTimecodes], RPM_SPEED[lbxRpmSpeed], SOFT_PREAMP[lbxSoftPA], LUT_MODES[lbxLookup], LOCK_MODES[lbxLock], TOLERANT[lbxBitErrors]);
 } 
 
+//----------------------------------------------------------------------------
+// calibration saved in patches
+//----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// the calibration belongs to the soundcard and turntables of a setup : saved
+// with patches and workspaces, not with presets
+int WaxDecoder::onGetChunkLen (LongBool Preset)
+{
+	if (Preset)
+		return 0;
+
+	return sizeof(CalibrationChunk);
+}
+
+//-----------------------------------------------------------------------------
+void WaxDecoder::onGetChunk (void* chunk, LongBool Preset)
+{
+	if (Preset)
+		return;
+
+	// latest calibration published by the audio thread, if it ever decoded
+	if (calibrationOut.acquire())
+		calibrationSaved = true;
+
+	if (calibrationSaved)
+	{
+		memcpy(chunk, &calibrationOut.front(), sizeof(CalibrationChunk));
+	}
+	else
+	{
+		CalibrationChunk empty;
+
+		memset(&empty, 0, sizeof(empty));
+		empty.magic = CHUNK_MAGIC;
+		empty.version = CHUNK_VERSION;
+		memcpy(chunk, &empty, sizeof(CalibrationChunk));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// handed to the audio thread, see restoreCalibration()
+void WaxDecoder::onSetChunk (const void* chunk, int sizeInBytes, LongBool Preset)
+{
+	CalibrationChunk & restored = calibrationIn.back();
+
+	if (Preset || sizeInBytes < (int)sizeof(CalibrationChunk))
+		return;
+
+	memcpy(&restored, chunk, sizeof(CalibrationChunk));
+
+	if (restored.magic != CHUNK_MAGIC || restored.version != CHUNK_VERSION
+		|| restored.numDecks < 0 || restored.numDecks > MAX_DECKS)
+		return;
+
+	restored.timecode[sizeof(restored.timecode) - 1] = '\0';
+	calibrationIn.publish();
+}
+
 //-----------------------------------------------------------------------------
 void WaxDecoder::onBlocSizeChange (int BlocSize)     
 /* nothing to do ? Usine asks to reboot after a block size change.
- * update the module even if Usine is not restarted */
+ * update the module even if Usine is not restarted : the bits of the
+ * smoothing loop are sized from the block size by the loader thread */
 {
 	usineBlockSize = BlocSize;
-
-	if (pcm != NULL)
-		delete[] pcm;
-
-	pcm = new signed short[usineBlockSize * 2];
+    loadTimecoder(TC_NAMES[lbxTimecodes], RPM_SPEED[lbxRpmSpeed], SOFT_PREAMP[lbxSoftPA], LUT_MODES[lbxLookup], LOCK_MODES[lbxLock], TOLERANT[lbxBitErrors]);
 }
 
 //-----------------------------------------------------------------------------
 void WaxDecoder::onSampleRateChange (double SampleRate)
 {
-    loadTimecoder(TC_NAMES[lbxTimecodes], RPM_SPEED[lbxRpmSpeed], SOFT_PREAMP[lbxSoftPA]);
+    loadTimecoder(TC_NAMES[lbxTimecodes], RPM_SPEED[lbxRpmSpeed], SOFT_PREAMP[lbxSoftPA], LUT_MODES[lbxLookup], LOCK_MODES[lbxLock], TOLERANT[lbxBitErrors]);
 }
 
 //-------------------------------------------------------------------------
@@ -246,87 +440,453 @@ void WaxDecoder::onProcess ()
 //-----------------------------------------------------------------------
 
 //-----------------------------------------------------------------------------
-// init the timecoder (return -1 if fails, 0 otherwise)
-int WaxDecoder::loadTimecoder(AnsiCharPtr tc_def, double speed, bool soft_pa)
+// ask the loader thread for decoders with new settings, the decks keep
+// decoding with the previous ones until the new ones are built
+void WaxDecoder::loadTimecoder(AnsiCharPtr tc_def, double speed, bool soft_pa, timecoder_lookup lookup, timecoder_lock lock, bool tolerant)
 {
-    TimecodeDefinition = timecoder_find_definition(tc_def);
-    
-    if (TimecodeDefinition == NULL)
-        return -1;
-    
     usineSmplRate = sdkGetSampleRate();
 
-    timecoder_init(&TCoder, TimecodeDefinition, speed, usineSmplRate, soft_pa);
-    
-    return 0;
+    std::lock_guard<std::mutex> guard(loaderMutex);
+
+    // only the latest settings are built
+    loaderRequest.tc_def = tc_def;
+    loaderRequest.speed = speed;
+    loaderRequest.soft_pa = soft_pa;
+    loaderRequest.lookup = lookup;
+    loaderRequest.lock = lock;
+    loaderRequest.tolerant = tolerant;
+    loaderRequest.sampleRate = usineSmplRate;
+    loaderRequest.blockSize = usineBlockSize;
+    loaderPending = true;
+    loaderBusy = true;
+
+    loaderWake.notify_one();
 }
 
 //-----------------------------------------------------------------------------
-// getting pitch and position from the decoder and writing to the module outputs
-int WaxDecoder::exportPlaybackParameters()
+// decoders of every deck for the given settings (return NULL if fails)
+// may build a lookup table and allocates : never on the audio thread
+DecoderState * WaxDecoder::buildState(const DecoderSettings & settings)
+{
+    DecoderState * state = new DecoderState;
+    int deck;
+
+    state->settings = settings;
+
+    // shared definition with the table asked for, held until the state is destroyed
+    state->definition = timecoder_find_definition(settings.tc_def, settings.lookup);
+
+    if (state->definition == NULL)
+    {
+        delete state;
+        return NULL;
+    }
+
+    // all decks are decoded together
+    if (timecoder_bank_init(&state->bank, numDecks) == -1)
+    {
+        timecoder_release_definition(state->definition);
+        delete state;
+        return NULL;
+    }
+
+    // at most one bit is read per sample
+    state->bits = new timecoder_bit[numDecks * settings.blockSize];
+
+    // all decks use the same definition and lookup table
+    for (deck = 0; deck < numDecks; ++deck)
+    {
+        timecoder * tc = timecoder_bank_deck(&state->bank, deck);
+
+        timecoder_init(tc, state->definition, settings.speed, settings.sampleRate, settings.soft_pa);
+        timecoder_set_lock(tc, settings.lock);
+        timecoder_set_tolerant(tc, settings.tolerant);
+    }
+
+    return state;
+}
+
+//-----------------------------------------------------------------------------
+// free decoders, the lookup table is freed with its last user
+void WaxDecoder::destroyState(DecoderState * state)
+{
+    unsigned int deck;
+
+    if (state == NULL)
+        return;
+
+    for (deck = 0; deck < state->bank.decks; ++deck)
+        timecoder_clear(timecoder_bank_deck(&state->bank, deck));
+
+    timecoder_bank_clear(&state->bank);
+    timecoder_release_definition(state->definition);
+    delete[] state->bits;
+    delete state;
+}
+
+//-----------------------------------------------------------------------------
+// loader thread : builds the decoders requested by loadTimecoder() and
+// destroys the ones replaced by the audio thread
+void WaxDecoder::loaderLoop()
+{
+    std::unique_lock<std::mutex> lock(loaderMutex);
+
+    while (!loaderQuit)
+    {
+        DecoderState * retired = retiredState.exchange(NULL);
+
+        if (retired != NULL)
+        {
+            lock.unlock();
+            destroyState(retired);
+            lock.lock();
+        }
+        else if (loaderPending)
+        {
+            DecoderSettings settings = loaderRequest;
+            loaderPending = false;
+
+            lock.unlock();
+
+            // new decoders replace staged ones the audio thread has not adopted yet,
+            // on failure the decks keep the decoders they have
+            DecoderState * state = buildState(settings);
+            if (state != NULL)
+                destroyState(stagedState.exchange(state));
+
+            lock.lock();
+
+            // staged before, see restoreCalibration()
+            if (!loaderPending)
+                loaderBusy = false;
+        }
+        else
+        {
+#ifdef _DEBUG
+            // the audio thread only counts the blocks the kernels decoded
+            // differently from the reference, they are traced from here
+            unsigned long failures = timecoder_get_verify_failures();
+
+            if (failures != verifyFailures)
+            {
+                char message[96];
+
+                snprintf(message, sizeof(message), "WaxDecoder : %lu blocks decoded differently by the reference kernel", failures);
+                sdkTraceErrorChar(message);
+                verifyFailures = failures;
+            }
+#endif
+
+            // the audio thread does not wake the loader, retired decoders wait a poll
+            loaderWake.wait_for(lock, std::chrono::milliseconds(LOADER_POLL_MS));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// audio thread : switch to staged decoders, unless the last ones replaced
+// are not destroyed yet. no lock, no allocation
+void WaxDecoder::adoptState()
+{
+    DecoderState * staged;
+    int deck;
+
+    // only the audio thread fills retiredState, only the loader empties it
+    if (retiredState.load() != NULL)
+        return;
+
+    staged = stagedState.exchange(NULL);
+    if (staged == NULL)
+        return;
+
+    // same timecode, other speed, sample rate, preamp, lookup table, lock or bit errors : the
+    // decks carry on from their current state and stay locked
+    if (activeState != NULL && strcmp(activeState->settings.tc_def, staged->settings.tc_def) == 0)
+    {
+        for (deck = 0; deck < numDecks; ++deck)
+        {
+            timecoder * tc = timecoder_bank_deck(&staged->bank, deck);
+
+            *tc = *timecoder_bank_deck(&activeState->bank, deck);
+            timecoder_set_definition(tc, staged->definition);
+            timecoder_reconfigure(tc, staged->settings.speed,
+                                  staged->settings.sampleRate, staged->settings.soft_pa);
+            timecoder_set_lock(tc, staged->settings.lock);
+            timecoder_set_tolerant(tc, staged->settings.tolerant);
+        }
+    }
+
+    // other timecode : the decks start from what they learnt of the signal
+    else if (activeState != NULL)
+    {
+        for (deck = 0; deck < numDecks; ++deck)
+        {
+            timecoder_calibration c;
+
+            timecoder_get_calibration(timecoder_bank_deck(&activeState->bank, deck), &c);
+            c.position = -1;
+            timecoder_set_calibration(timecoder_bank_deck(&staged->bank, deck), &c);
+        }
+    }
+
+    retiredState.store(activeState);
+    activeState = staged;
+}
+
+//-----------------------------------------------------------------------------
+// audio thread : start the decks from a calibration loaded with a patch, the
+// positions only if the decks use the timecode they were saved in. the
+// patch sets the timecode too : while decoders are still on their way
+// from the loader, a calibration of another timecode waits for them
+void WaxDecoder::restoreCalibration()
+{
+    const CalibrationChunk * chunk;
+    bool sameTimecode;
+    int deck;
+
+    if (calibrationIn.acquire())
+        calibrationPending = true;
+
+    if (activeState == NULL || !calibrationPending)
+        return;
+
+    chunk = &calibrationIn.front();
+    sameTimecode = (strcmp(chunk->timecode, activeState->settings.tc_def) == 0);
+
+    // the loader stages new decoders before it is no longer busy
+    if (!sameTimecode && (loaderBusy.load() || stagedState.load() != NULL))
+        return;
+
+    calibrationPending = false;
+
+    // the decks past the ones saved keep what they learnt
+    for (deck = 0; deck < numDecks && deck < chunk->numDecks; ++deck)
+    {
+        timecoder_calibration c = chunk->decks[deck];
+
+        if (!sameTimecode)
+            c.position = -1;
+
+        timecoder_set_calibration(timecoder_bank_deck(&activeState->bank, deck), &c);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// audio thread : publish the calibration of the decks for onGetChunk()
+void WaxDecoder::saveCalibration()
+{
+    CalibrationChunk & chunk = calibrationOut.back();
+    int deck;
+
+    // saved as is in the patch : no byte left from an earlier chunk, nor
+    // from the padding or the decks past numDecks
+    memset(&chunk, 0, sizeof(chunk));
+
+    chunk.magic = CHUNK_MAGIC;
+    chunk.version = CHUNK_VERSION;
+    strncpy(chunk.timecode, activeState->settings.tc_def, sizeof(chunk.timecode) - 1);
+    chunk.timecode[sizeof(chunk.timecode) - 1] = '\0';
+    chunk.numDecks = numDecks;
+
+    for (deck = 0; deck < numDecks; ++deck)
+        timecoder_get_calibration(timecoder_bank_deck(&activeState->bank, deck), &chunk.decks[deck]);
+
+    calibrationOut.publish();
+}
+
+//-----------------------------------------------------------------------------
+// getting pitch and position from the decoder of a deck and writing to its outputs
+int WaxDecoder::exportPlaybackParameters(int deck)
 {
     /* FROM 'sync_to_timecode(struct player)' in player.c xwax sources */
     /*******************************************************************/
-    double when, tcpos;
+    timecoder * tc = timecoder_bank_deck(&activeState->bank, deck);
+    double when, tcpos, previous;
     signed int timecode;
 
-    timecode = timecoder_get_position(&TCoder, &when);
+    timecode = timecoder_get_position(tc, &when);
+    previous = target_position[deck];   // MODS for the smoothing loop
 
     /* Instruct the caller to disconnect the timecoder if the needle
      * is outside the 'safe' zone of the record */
 
-    if (timecode != -1 && timecode > timecoder_get_safe(&TCoder))
+    if (timecode != -1 && timecode > timecoder_get_safe(tc))
         return -1;
 
     /* If the timecoder is alive, use the pitch from the sine wave */
 
-    pitch = timecoder_get_pitch(&TCoder);
+    pitch[deck] = timecoder_get_pitch(tc);
 
     /* If we can read an absolute time from the timecode, then use it */
 
     if (timecode == -1)
-        target_position = TARGET_UNKNOWN;
+        holdPosition(deck);   // MODS instead of TARGET_UNKNOWN at once
     else
     {
-        tcpos = (double)timecode / timecoder_get_resolution(&TCoder);
-        target_position = tcpos + pitch * when;
+        tcpos = (double)timecode / timecoder_get_resolution(tc);
+        target_position[deck] = tcpos + pitch[deck] * when;
+        heldTime[deck] = 0.;
     }
     /*******************************************************************/
     
     // set outputs
-    sdkSetEvtData(dtfPositionOut, target_position);
-    sdkSetEvtData(dtfPitchOut, pitch);
+    sdkSetEvtData(dtfPositionOut[deck], followPosition(deck, previous));
+    sdkSetEvtData(dtfPitchOut[deck], pitch[deck]);
+    sdkSetEvtData(ledMeasuredOut[deck], timecode != -1 ? 1. : 0.);
     
     return 0;
 }
 
 //-----------------------------------------------------------------------------
-// pcm conversion from Usine stereo audio inputs to xwax decoder
-void WaxDecoder::writeCompatibleAudio(signed short*& pcm)
+// no position read in this block : the last one carries on at the pitch of the
+// disc for the hold time, then the position is unknown until read again. a
+// held position off the record, before its start or past the 'safe' zone,
+// is unknown, as a position read there
+void WaxDecoder::holdPosition(int deck)
 {
-    int i;
-    
-    for(i=0; i < usineBlockSize; ++i)
-    {         
-        pcm[2*i] = 32768 * sdkGetEvtArrayData(audioInputTab[0], i);
-        pcm[2*i+1] = 32768 * sdkGetEvtArrayData(audioInputTab[1], i);
+    timecoder * tc = timecoder_bank_deck(&activeState->bank, deck);
+    double elapsed = usineBlockSize / (double)activeState->settings.sampleRate;
+
+    heldTime[deck] += elapsed;
+
+    if (target_position[deck] == TARGET_UNKNOWN || heldTime[deck] * 1000. > holdTime)
+        target_position[deck] = TARGET_UNKNOWN;
+    else
+    {
+        target_position[deck] += pitch[deck] * elapsed;
+
+        if (target_position[deck] < 0.
+            || target_position[deck] * timecoder_get_resolution(tc) > timecoder_get_safe(tc))
+            target_position[deck] = TARGET_UNKNOWN;
     }
 }
 
+//-----------------------------------------------------------------------------
+// second-order loop following the position of the deck sample by sample, from
+// the bits read in the block and the position at the end of the previous one :
+// the smoothed position at the end of the block, or the position if it is off
+// or if bits were dropped (a block larger than the bits, until they are resized)
+double WaxDecoder::followPosition(int deck, double previous)
+{
+    timecoder * tc = timecoder_bank_deck(&activeState->bank, deck);
+    double bandwidth = LOOP_BANDWIDTHS[smoothing];
+    const timecoder_bit * bit = activeState->bits + deck * activeState->settings.blockSize;
+    size_t bits = timecoder_get_bits(tc);
+    float * audio = NULL;
+    double dt, wn, reference, error, step;
+    int n;
+
+    if (bandwidth == 0. || target_position[deck] == TARGET_UNKNOWN || timecoder_get_bits_dropped(tc) > 0)
+    {
+        loop_position[deck] = TARGET_UNKNOWN;
+        return target_position[deck];
+    }
+
+    // the audio position output follows the loop too
+    if (audioOutputs)
+        audio = sdkGetEvtDataAddr(audioOutputTab[deck][0]);
+
+    dt = 1. / activeState->settings.sampleRate;
+    wn = 2. * PI * bandwidth;
+    reference = previous;   // position of the disc after each sample
+
+    for (n = 0; n < usineBlockSize; ++n)
+    {
+        if (bits > 0 && bit->offset == (size_t)n)
+        {
+            reference = bit->position / timecoder_get_resolution(tc);
+            bit++;
+            bits--;
+        }
+
+        // not known until the first bit of the block
+        if (reference == TARGET_UNKNOWN)
+        {
+            if (audio != NULL)
+                audio[n] = -1.f;
+            continue;
+        }
+        reference += pitch[deck] * dt;
+
+        // a needle drop, or the first position : no smoothing
+        error = reference - loop_position[deck];
+        if (loop_position[deck] == TARGET_UNKNOWN || fabs(error) > SNAP_DISTANCE)
+        {
+            loop_position[deck] = reference;
+            loop_pitch[deck] = pitch[deck];
+            error = 0.;
+        }
+
+        loop_pitch[deck] += wn * wn * error * dt;
+        step = (loop_pitch[deck] + 2. * LOOP_DAMPING * wn * error) * dt;
+
+        // the position never goes against the disc, whatever the bits
+        if ((pitch[deck] > 0. && step < 0.) || (pitch[deck] < 0. && step > 0.))
+            step = 0.;
+
+        loop_position[deck] += step;
+
+        if (audio != NULL)
+            audio[n] = (float)loop_position[deck];
+    }
+
+    // known with no bit in the block (calibration restored) : start from there
+    if (reference == TARGET_UNKNOWN)
+    {
+        loop_position[deck] = target_position[deck];
+        loop_pitch[deck] = pitch[deck];
+    }
+
+    return loop_position[deck];
+}
+
 //-----------------------------------------------------------------------------
 // main process
 void WaxDecoder::outputTCoder()
 {
-    // get 'xwax compatible' audio from inputs
-    writeCompatibleAudio(pcm);
-    
-    // submit block to timecoder
-    timecoder_submit(&TCoder, pcm, usineBlockSize);
+    const float * left[MAX_DECKS];
+    const float * right[MAX_DECKS];
+    int deck;
+
+    adoptState();
+
+    if (activeState == NULL)
+        return;
+
+    restoreCalibration();
+
+    // submit Usine audio blocks of every deck to the timecoder bank as they are, no copy
+    for (deck = 0; deck < numDecks; ++deck)
+    {
+        left[deck] = sdkGetEvtDataAddr(audioInputTab[deck][0]);
+        right[deck] = sdkGetEvtDataAddr(audioInputTab[deck][1]);
+
+        // position and pitch of every sample written by the decoder as it goes,
+        // given again each block as the decoders may have been replaced
+        if (audioOutputs)
+            timecoder_set_trace(timecoder_bank_deck(&activeState->bank, deck),
+                                sdkGetEvtDataAddr(audioOutputTab[deck][0]),
+                                sdkGetEvtDataAddr(audioOutputTab[deck][1]));
+
+        // bits read, for the position smoothing loop
+        timecoder_set_bits(timecoder_bank_deck(&activeState->bank, deck),
+                           smoothing != 0 ? activeState->bits + deck * activeState->settings.blockSize : NULL,
+                           activeState->settings.blockSize);
+    }
+
+    timecoder_bank_submit(&activeState->bank, left, right, usineBlockSize);
     
     // decode and output playback infos
-    if (exportPlaybackParameters() == -1)
+    for (deck = 0; deck < numDecks; ++deck)
     {
-        sdkSetEvtData(dtfPositionOut, TARGET_UNKNOWN);
-        sdkSetEvtData(dtfPitchOut, 0.);
+        if (exportPlaybackParameters(deck) == -1)
+        {
+            target_position[deck] = TARGET_UNKNOWN;
+            loop_position[deck] = TARGET_UNKNOWN;
+            sdkSetEvtData(dtfPositionOut[deck], TARGET_UNKNOWN);
+            sdkSetEvtData(dtfPitchOut[deck], 0.);
+            sdkSetEvtData(ledMeasuredOut[deck], 0.);
+        }
     }
+    saveCalibration();
 }
@@ -50,6 +50,11 @@
 //-----------------------------------------------------------------------------
 // includes
 //-----------------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "./sdk/UserDefinitions.h"  
 #include "./xwax_src/timecoder.h"
 
@@ -75,6 +80,110 @@ double const RPM_SPEED[2] = {1., 1.35};
 // 'software preamp' for unamplified phono signal connected to a line-level input
 bool const SOFT_PREAMP[2] = {FALSE, TRUE};
 
+// lookup tables : full (fast, megabytes) or compact (slower lookups, kilobytes)
+timecoder_lookup const LUT_MODES[2] = {TIMECODER_LOOKUP_FULL, TIMECODER_LOOKUP_SPARSE};
+
+// first position after a needle drop : after 24 checked bits, or sooner once lookups agree
+timecoder_lock const LOCK_MODES[2] = {TIMECODER_LOCK_BITS, TIMECODER_LOCK_ADJACENT};
+
+// bits read wrongly from dust and clicks : lose the position, or correct them
+bool const TOLERANT[2] = {FALSE, TRUE};
+
+// position smoothing : bandwidth in Hz of the loop following the position of
+// each deck, 0 for the position as decoded
+double const LOOP_BANDWIDTHS[4] = {0., 20., 8., 3.};
+#define LOOP_DAMPING 0.707   // of the loop, settles fast with little overshoot
+#define SNAP_DISTANCE 0.1    // s, further than the decoded position is a needle drop
+
+// decks per module, chosen in the query popup when the module is inserted,
+// and whether the decks also have audio outputs
+int const DECK_COUNTS[8] = {1, 2, 4, 8, 1, 2, 4, 8};
+bool const AUDIO_OUTPUTS[8] = {FALSE, FALSE, FALSE, FALSE, TRUE, TRUE, TRUE, TRUE};
+#define MAX_DECKS 8
+
+// parameters of each deck : audio in L and R, position and pitch outputs
+#define PARAMS_PER_DECK 4
+
+// then for each deck, after the parameters of all decks so that those keep
+// their index in patches : position measured (1) or held (0) output
+#define FLAGS_PER_DECK 1
+
+// then if chosen for each deck : position and pitch audio outputs, per sample
+#define AUDIO_OUTPUTS_PER_DECK 2
+
+// how often the loader thread looks for decoders replaced by the audio thread
+#define LOADER_POLL_MS 50
+
+//-----------------------------------------------------------------------------
+// decoders of all the decks for one set of settings, built off the audio thread
+//-----------------------------------------------------------------------------
+struct DecoderSettings
+{
+    AnsiCharPtr tc_def;
+    double speed;
+    bool soft_pa;
+    timecoder_lookup lookup;
+    timecoder_lock lock;
+    bool tolerant;
+    unsigned int sampleRate;
+    int blockSize;
+};
+
+//-----------------------------------------------------------------------------
+// calibration of the decks saved in patches, to relock at once when loaded
+//-----------------------------------------------------------------------------
+#define CHUNK_MAGIC 0x43584157   // 'WAXC'
+#define CHUNK_VERSION 1
+
+struct CalibrationChunk
+{
+    int magic;
+    int version;
+    char timecode[16];   // definition the positions are in
+    int numDecks;        // 0 if the decks never decoded
+    timecoder_calibration decks[MAX_DECKS];
+};
+
+//-----------------------------------------------------------------------------
+// latest value handed from one thread to another without waiting :
+// the writer fills back() then calls publish(), the reader calls
+// acquire() then reads front()
+//-----------------------------------------------------------------------------
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), backIdx(0), frontIdx(2) {}
+
+    T & back() { return buffers[backIdx]; }
+    const T & front() const { return buffers[frontIdx]; }
+
+    void publish() { backIdx = middle.exchange(backIdx | FRESH) & ~FRESH; }
+
+    // return true if front() changed
+    bool acquire()
+    {
+        if (!(middle.load() & FRESH))
+            return false;
+        frontIdx = middle.exchange(frontIdx) & ~FRESH;
+        return true;
+    }
+
+private:
+    enum { FRESH = 4 };
+    T buffers[3];
+    std::atomic<int> middle;   // index, FRESH if written since the last acquire()
+    int backIdx, frontIdx;
+};
+
+struct DecoderState
+{
+    DecoderSettings settings;
+    timecode_def * definition;   // held until the state is destroyed
+    timecoder_bank bank;
+    timecoder_bit * bits;        // blockSize bits read per deck, the loop input
+};
+
 //-----------------------------------------------------------------------------
 // class definition
 //-----------------------------------------------------------------------------
@@ -100,7 +209,9 @@ public:
 	void onGetModuleInfo (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo);
 
 	//-------------------------------------------------------------------------
-	// init
+	// query system and init
+	int  onGetNumberOfParams (int queryIndex);
+	void onAfterQuery (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo, int queryIndex);
 	void onInitModule (MasterInfo* pMasterInfo, ModuleInfo* pModuleInfo);
 
 	//-------------------------------------------------------------------------
@@ -114,6 +225,12 @@ public:
 	void onCreateSettings();
 	void onSettingsHasChanged();
 
+	//-------------------------------------------------------------------------
+	// calibration saved in patches
+	int  onGetChunkLen (LongBool Preset);
+	void onGetChunk (void* chunk, LongBool Preset);
+	void onSetChunk (const void* chunk, int sizeInBytes, LongBool Preset);
+
  	//-----------------------------------------------------------------------------
 	// audio setup update
 	void onBlocSizeChange (int BlocSize);
@@ -124,43 +241,82 @@ public:
 	//-------------------------------------------------------------------------
 private:
 	//-------------------------------------------------------------------------
-	// parameters events
-    UsineEventPtr audioInputTab[2];   // stereo audio input
-    UsineEventPtr dtfPositionOut;     // position data output
-    UsineEventPtr dtfPitchOut;        // pitch data output
+	// parameters events, per deck
+    int numDecks;
+    UsineEventPtr audioInputTab[MAX_DECKS][2];   // stereo audio input
+    UsineEventPtr dtfPositionOut[MAX_DECKS];     // position data output
+    UsineEventPtr dtfPitchOut[MAX_DECKS];        // pitch data output
+    UsineEventPtr ledMeasuredOut[MAX_DECKS];     // position measured flag output
+    UsineEventPtr audioOutputTab[MAX_DECKS][2];  // position and pitch audio output
+    bool audioOutputs;
+    char captionTab[MAX_DECKS * (PARAMS_PER_DECK + FLAGS_PER_DECK + AUDIO_OUTPUTS_PER_DECK)][16];
 
 	//-------------------------------------------------------------------------
     // Usine and soundcard audio settings
-    int usineBlockSize;               // used to translate Usine audio blocks to xwax buffer
+    std::atomic<int> usineBlockSize;  // samples per Usine audio block, set out of the audio thread
     unsigned int usineSmplRate;       // used to init the timecoder
 
 	//-------------------------------------------------------------------------
-    // timecode definition and timecoder
-    timecode_def * TimecodeDefinition;
-    timecoder TCoder;
+    // decoders of the decks, only used by the audio thread, and the ones
+    // staged to replace them or replaced, exchanged with the loader thread
+    DecoderState * activeState;
+    std::atomic<DecoderState*> stagedState;    // built, not adopted yet
+    std::atomic<DecoderState*> retiredState;   // replaced, not destroyed yet
+
+	//-------------------------------------------------------------------------
+    // loader thread, building the decoders for the latest settings
+    std::thread loaderThread;
+    std::mutex loaderMutex;
+    std::condition_variable loaderWake;
+    DecoderSettings loaderRequest;   // under loaderMutex
+    bool loaderPending;              // under loaderMutex
+    std::atomic<bool> loaderBusy;    // set under loaderMutex, requested and not staged yet
+    bool loaderQuit;                 // under loaderMutex
+    unsigned long verifyFailures;    // loader thread only, traced so far (debug)
     
- 	//-------------------------------------------------------------------------
-    // audio samples for timecoder lib
-    signed short * pcm;
+	//-------------------------------------------------------------------------
+    // calibration of the decks, published by the audio thread for onGetChunk()
+    // and handed to it by onSetChunk()
+    TripleBuffer<CalibrationChunk> calibrationOut;
+    TripleBuffer<CalibrationChunk> calibrationIn;
+    bool calibrationSaved;       // chunk callbacks only, calibrationOut has been read
+    bool calibrationPending;     // audio thread only, calibrationIn waits for its timecode
 
 	//-------------------------------------------------------------------------
-    // output
-    double target_position;           // seconds or TARGET_UNKNOWN
-    double pitch;
+    // output, per deck
+    double target_position[MAX_DECKS];   // seconds or TARGET_UNKNOWN
+    double pitch[MAX_DECKS];
+    double heldTime[MAX_DECKS];          // seconds since the position was last read
+    std::atomic<int> holdTime;           // ms a position is held for, set out of the audio thread
+    double loop_position[MAX_DECKS];     // seconds or TARGET_UNKNOWN, of the smoothing loop
+    double loop_pitch[MAX_DECKS];
+    std::atomic<int> smoothing;          // index in LOOP_BANDWIDTHS, set out of the audio thread
 	
 	//-------------------------------------------------------------------------
 	// hardware settings
 	int lbxTimecodes;
     int lbxRpmSpeed;
 	int lbxSoftPA;
+	int lbxLookup;
+	int lbxLock;
+	int lbxBitErrors;
+	int intHoldTime;
+	int lbxSmoothing;
 	
 	//-------------------------------------------------------------------------
 	// private methods
 	//-------------------------------------------------------------------------
 private :
-    int loadTimecoder(AnsiCharPtr tc_def, double speed, bool soft_pa);
-    int exportPlaybackParameters();
-    void writeCompatibleAudio(signed short*& pcm);
+    void loadTimecoder(AnsiCharPtr tc_def, double speed, bool soft_pa, timecoder_lookup lookup, timecoder_lock lock, bool tolerant);
+    DecoderState * buildState(const DecoderSettings & settings);
+    static void destroyState(DecoderState * state);
+    void loaderLoop();
+    void adoptState();
+    void saveCalibration();
+    void restoreCalibration();
+    int exportPlaybackParameters(int deck);
+    void holdPosition(int deck);
+    double followPosition(int deck, double previous);
     void outputTCoder();
 
 }; // class WaxDecoder
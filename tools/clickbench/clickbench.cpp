@@ -0,0 +1,213 @@
+//-----------------------------------------------------------------------------
+//@file
+//	clickbench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Fraction of the output time without a position, once the decoder first
+//	locked, on every timecode with clicks or dust injected at a few rates,
+//	strict as xwax and tolerant of bit errors. Clicks are decaying impulses
+//	on both channels, dust a cycle read as the wrong bit; they are played at
+//	the nominal speed with a little wow, clicks also scratched. Positions
+//	off the record by more than the bits of a code are counted as false.
+//
+//	usage: clickbench [sample rate]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define BLOCK 64          // samples, small for the resolution of the blind time
+#define SECONDS 20.0      // of signal
+#define NOISE 0.002       // peak, of a full scale of 1
+
+enum kind { CLICKS, DUST, SCRATCH, KINDS };
+
+static const char * const KIND_NAMES[KINDS] = { "clicks", "dust", "scratch" };
+
+static const double EVENTS[] = { 0.0, 1.0, 5.0, 20.0 }; // per second, none for the reference
+#define EVENT_RATES (sizeof(EVENTS) / sizeof(EVENTS[0]))
+
+//-----------------------------------------------------------------------------
+// a record played with clicks or dust, and the position played at the end
+// of each block
+//-----------------------------------------------------------------------------
+struct record {
+    std::vector<float> left, right;
+    std::vector<double> position;
+};
+
+//-----------------------------------------------------------------------------
+static void play(const timecode_def *def, unsigned int rate, kind k, double events,
+                 record *r)
+{
+    double t, speed;
+    size_t n, i;
+    synth s;
+
+    synth_init(&s, def, rate);
+    s.noise = NOISE;
+
+    n = (size_t)(SECONDS * rate);
+    n -= n % BLOCK;
+    r->left.resize(n);
+    r->right.resize(n);
+    r->position.resize(n / BLOCK);
+
+    for (i = 0; i < n; ++i)
+    {
+        if ((synth_random(&s) + 1.0) / 2.0 < events / rate)
+        {
+            if (k == DUST)
+                s.dust = (long)floor(s.position);
+            else
+                synth_click(&s, (synth_random(&s) < 0.0 ? -1.0 : 1.0)
+                                * (0.65 + 0.35 * synth_random(&s)));
+        }
+
+        t = (double)i / rate;
+        speed = (k == SCRATCH) ? synth_scratch(t) : 1.0 + 0.002 * sin(2.0 * SYNTH_PI * 0.55 * t);
+        synth_play(&s, &r->left[i], &r->right[i], 1, speed);
+
+        if ((i + 1) % BLOCK == 0)
+            r->position[i / BLOCK] = s.position;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// fraction of the blocks without a position once the decoder first locked,
+// and the blocks with a false one
+static double blind(timecode_def *def, unsigned int rate, const record &r, bool tolerant,
+                    unsigned long *wrong)
+{
+    unsigned long blocks, none;
+    signed int position;
+    double offset, error;
+    bool locked;
+    timecoder tc;
+    size_t n;
+
+    timecoder_init(&tc, def, 1.0, rate, false);
+    timecoder_set_tolerant(&tc, tolerant);
+
+    blocks = none = 0;
+    offset = 0.0;
+    locked = false;
+
+    for (n = 0; n < r.position.size(); ++n)
+    {
+        timecoder_submit_planar_float(&tc, &r.left[n * BLOCK], &r.right[n * BLOCK], BLOCK);
+        position = timecoder_get_position(&tc, NULL);
+
+        // cycles between the position reported and the one played
+        if (!locked)
+        {
+            if (position == -1)
+                continue;
+            locked = true;
+            offset = position - r.position[n];
+        }
+
+        blocks++;
+        if (position == -1)
+        {
+            none++;
+            continue;
+        }
+
+        error = position - r.position[n] - offset;
+        if (error > def->bits + 4 || error < -(double)(def->bits + 4))
+            (*wrong)++;
+    }
+
+    timecoder_clear(&tc);
+
+    return blocks ? (double)none / blocks : 1.0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    unsigned long wrong;
+    unsigned int rate;
+    timecode_def *def;
+    record r;
+    size_t e;
+    int i, k;
+
+    rate = (argc > 1) ? (unsigned int)atoi(argv[1]) : 44100;
+    if (rate == 0)
+    {
+        fprintf(stderr, "usage: clickbench [sample rate]\n");
+        return 1;
+    }
+
+    printf("%-15s %-8s", "blind %", "");
+    for (e = 0; e < EVENT_RATES; ++e)
+        printf(" | %4.0f/s strict tolerant", EVENTS[e]);
+    printf(" | false\n");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_FULL);
+        if (def == NULL)
+        {
+            fprintf(stderr, "clickbench: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+
+        for (k = 0; k < KINDS; ++k)
+        {
+            printf("%-15s %-8s", k == 0 ? SYNTH_NAMES[i] : "", KIND_NAMES[k]);
+            fflush(stdout);
+
+            wrong = 0;
+            for (e = 0; e < EVENT_RATES; ++e)
+            {
+                play(def, rate, (kind)k, EVENTS[e], &r);
+                printf(" | %13.2f", 100.0 * blind(def, rate, r, false, &wrong));
+                printf(" %8.2f", 100.0 * blind(def, rate, r, true, &wrong));
+                fflush(stdout);
+            }
+            printf(" | %5lu\n", wrong);
+        }
+
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+    }
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+//-----------------------------------------------------------------------------
+//@file
+//	synth.h
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Timecodes and timecode signals generated from their definitions, for the
+//	benchmarks under tools/. Only the parameters of a definition are used,
+//	so that what is measured is never checked against itself.
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+#ifndef SYNTH_H
+#define SYNTH_H
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../../xwax_src/timecoder.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+
+// timecodes of the xwax table, as TC_NAMES in WaxDecoder.h
+#define SYNTH_TIMECODES 7
+
+static const char * const SYNTH_NAMES[SYNTH_TIMECODES] = {
+    "serato_2a",
+    "serato_2b",
+    "serato_cd",
+    "traktor_a",
+    "traktor_b",
+    "mixvibes_v2",
+    "mixvibes_7inch"
+};
+
+// flags of the definitions, as in timecoder.cpp
+#define SYNTH_PHASE 0x1     // tone phase difference of 270 (not 90) degrees
+#define SYNTH_PRIMARY 0x2   // left channel (not right) as primary
+
+#define SYNTH_PI 3.14159265358979323846
+
+// levels of the signal, of a full scale of 1
+#define SYNTH_LEVEL 0.4     // peak of a cycle carrying a 1
+#define SYNTH_ZERO 0.6      // of that, for a cycle carrying a 0
+#define SYNTH_RUMBLE 0.02   // at 3 Hz, on the primary
+
+//-----------------------------------------------------------------------------
+// seconds on a monotonic clock
+static inline double synth_now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//-----------------------------------------------------------------------------
+// the next code of the LFSR, stepped one bit at a time as the record
+// does, new bits being added at the MSB
+static inline unsigned int synth_fwd(unsigned int code, const timecode_def *def)
+{
+    unsigned int taps, l;
+
+    l = 0;
+    for (taps = code & (def->taps | 0x1); taps != 0; taps >>= 1)
+        l ^= taps & 0x1;
+
+    return (code >> 1) | (l << (def->bits - 1));
+}
+
+//-----------------------------------------------------------------------------
+// the code of every position of a definition, in order
+static inline void synth_codes(const timecode_def *def, std::vector<unsigned int> &codes)
+{
+    unsigned int code, n;
+
+    codes.resize(def->length);
+    code = def->seed;
+    for (n = 0; n < def->length; ++n)
+    {
+        codes[n] = code;
+        code = synth_fwd(code, def);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// signal of a record played from a given position
+//-----------------------------------------------------------------------------
+struct synth {
+    const timecode_def *def;
+    std::vector<unsigned char> bit; // bit carried by each cycle
+    unsigned int rate;
+    double position;    // in cycles
+    double level;       // 1 when playing, 0 with the needle lifted
+    double noise;       // peak of the noise added to both channels
+    double click[2];    // decaying impulse on each channel
+    long dust;          // cycle read as the wrong bit, or -1
+    unsigned long long ticker; // samples since the start
+    unsigned int seed;
+};
+
+//-----------------------------------------------------------------------------
+// uniform in [-1, 1), the same on every platform
+static inline double synth_random(synth *s)
+{
+    s->seed ^= s->seed << 13;
+    s->seed ^= s->seed >> 17;
+    s->seed ^= s->seed << 5;
+    return s->seed / 2147483648.0 - 1.0;
+}
+
+//-----------------------------------------------------------------------------
+// a record of the definition at 10 seconds, playing without noise
+static inline void synth_init(synth *s, const timecode_def *def, unsigned int rate)
+{
+    std::vector<unsigned int> codes;
+    unsigned int n;
+
+    synth_codes(def, codes);
+    s->bit.resize(codes.size());
+    for (n = 0; n < codes.size(); ++n)
+        s->bit[n] = (codes[n] >> (def->bits - 1)) & 0x1;
+
+    s->def = def;
+    s->rate = rate;
+    s->position = def->resolution * 10.0;
+    s->level = 1.0;
+    s->noise = 0.0;
+    s->click[0] = s->click[1] = 0.0;
+    s->dust = -1;
+    s->ticker = 0;
+    s->seed = 0x2545f491;
+}
+
+//-----------------------------------------------------------------------------
+// a click on both channels, decaying over a few samples
+static inline void synth_click(synth *s, double amplitude)
+{
+    s->click[0] = amplitude;
+    s->click[1] = amplitude * (0.8 + 0.2 * synth_random(s));
+}
+
+//-----------------------------------------------------------------------------
+// n samples played at the given speed (1 is the nominal speed, negative
+// backwards), as the left and right channels of the deck
+static inline void synth_play(synth *s, float *left, float *right, size_t n,
+                              double speed)
+{
+    double step, t, a, phase, primary, secondary;
+    size_t i;
+    long k;
+
+    step = speed * s->def->resolution / s->rate;
+
+    for (i = 0; i < n; ++i)
+    {
+        s->position += step;
+        k = (long)floor(s->position);
+        phase = 2.0 * SYNTH_PI * (s->position - k);
+
+        a = (k >= 0 && k < (long)s->bit.size() && s->bit[k]) ? 1.0 : SYNTH_ZERO;
+        if (k == s->dust)
+            a = (a == 1.0) ? SYNTH_ZERO : 1.0;
+        a *= SYNTH_LEVEL * s->level;
+
+        primary = a * sin(phase) + s->click[0] + s->noise * synth_random(s);
+        secondary = -a * cos(phase) + s->click[1] + s->noise * synth_random(s);
+        s->click[0] *= 0.8;
+        s->click[1] *= 0.8;
+
+        t = (double)s->ticker++ / s->rate;
+        primary += SYNTH_RUMBLE * sin(2.0 * SYNTH_PI * 3.0 * t);
+
+        if (s->def->flags & SYNTH_PRIMARY)
+        {
+            left[i] = (float)primary;
+            right[i] = (float)secondary;
+        }
+        else
+        {
+            left[i] = (float)secondary;
+            right[i] = (float)primary;
+        }
+
+        if (s->def->flags & SYNTH_PHASE)
+            left[i] = -left[i];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// speed of a DJ scratching back and forth around the nominal speed, after
+// one second of play
+static inline double synth_scratch(double t)
+{
+    return (t < 1.0) ? 1.0 : 1.0 + 1.5 * sin(2.0 * SYNTH_PI * 0.7 * t);
+}
+
+//-----------------------------------------------------------------------------
+// a whole signal, scratched or played at the nominal speed
+static inline void synth_record(const timecode_def *def, unsigned int rate,
+                                double seconds, bool scratch,
+                                std::vector<float> &left, std::vector<float> &right)
+{
+    size_t n, i;
+    synth s;
+
+    synth_init(&s, def, rate);
+
+    n = (size_t)(seconds * rate);
+    left.resize(n);
+    right.resize(n);
+
+    for (i = 0; i < n; ++i)
+        synth_play(&s, &left[i], &right[i], 1, scratch ? synth_scratch((double)i / rate) : 1.0);
+}
+
+#endif
@@ -0,0 +1,182 @@
+//-----------------------------------------------------------------------------
+//@file
+//	idlecheck.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Checks the runs of samples without a crossing, which the decoder gives
+//	the pitch filter at once with pitch_idle_observations(), against the
+//	same number of observations one by one as xwax did, for several sample
+//	rates and run lengths. Single runs are checked from a few states of the
+//	filter, then runs between crossings as the decoder sees them. Fails if
+//	the pitch or the position of the filter diverge by more than rounding.
+//
+//	usage: idlecheck
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+
+#include "../../xwax_src/pitch.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define CROSSINGS 20000 // runs between crossings, for each rate
+
+static const unsigned int RATES[] = { 22050, 44100, 48000, 96000, 192000 };
+
+// around the powers of two the runs are split into, and past the largest
+static const unsigned long RUNS[] = {
+    1, 2, 3, 7, 8, 9, 15, 16, 17, 100, 511, 512, 513, 1000, 4096,
+    32767, 32768, 32769, 65535, 65536, 65537, 100000, 1000000
+};
+
+// states of the filter a run starts from: position, pitch
+static const double STATES[][2] = {
+    { 0.0, 0.0 }, { 0.0, 1.0 }, { 1e-4, 1.0 }, { -2e-3, -1.5 }, { 5e-3, 3.0 }
+};
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+//-----------------------------------------------------------------------------
+// divergence of the filter in closed form from the one stepped, relative
+// to the tolerance of the decoder (see idle_samples() in timecoder.cpp);
+// over 1 is a failure
+//-----------------------------------------------------------------------------
+static double divergence(const struct pitch *p, const struct pitch *ref)
+{
+    double dv, dx;
+
+    dv = fabs(p->v - ref->v) / (1e-9 * (fabs(ref->v) + 1e-3));
+    dx = fabs(p->x - ref->x) / (1e-9 * (fabs(ref->x) + 1e-6));
+
+    return dv > dx ? dv : dx;
+}
+
+//-----------------------------------------------------------------------------
+static void step(struct pitch *p, unsigned long n)
+{
+    for (; n > 0; --n)
+        pitch_dt_observation(p, 0.0);
+}
+
+//-----------------------------------------------------------------------------
+// uniform in [0, 1), the same on every platform
+static double uniform(unsigned int *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state / 4294967296.0;
+}
+
+//-----------------------------------------------------------------------------
+int main()
+{
+    struct pitch p, ref;
+    unsigned long n;
+    unsigned int state;
+    double dt, worst_run, worst_chain, d, dx;
+    size_t r, i, s;
+    int failed;
+
+    failed = 0;
+
+    printf("%-7s | %12s | %12s\n", "rate", "single runs", "decoding");
+
+    for (r = 0; r < ARRAY_LEN(RATES); ++r)
+    {
+        dt = 1.0 / RATES[r];
+
+        // each run on its own, from a few states of the filter
+        worst_run = 0.0;
+        for (s = 0; s < ARRAY_LEN(STATES); ++s)
+        {
+            for (i = 0; i < ARRAY_LEN(RUNS); ++i)
+            {
+                pitch_init(&p, dt);
+                p.x = STATES[s][0];
+                p.v = STATES[s][1];
+                ref = p;
+
+                pitch_idle_observations(&p, RUNS[i]);
+                step(&ref, RUNS[i]);
+
+                d = divergence(&p, &ref);
+                if (d > worst_run)
+                    worst_run = d;
+                if (d > 1.0)
+                {
+                    fprintf(stderr, "idlecheck: %u Hz, run of %lu from x %g v %g: "
+                            "v %.17g/%.17g, x %.17g/%.17g\n", RATES[r], RUNS[i],
+                            STATES[s][0], STATES[s][1], p.v, ref.v, p.x, ref.x);
+                    failed = 1;
+                }
+            }
+        }
+
+        // runs between the crossings of a record played at about the
+        // nominal speed, both filters given the same crossings
+        pitch_init(&p, dt);
+        pitch_init(&ref, dt);
+        state = 0x2545f491;
+        worst_chain = 0.0;
+        for (i = 0; i < CROSSINGS; ++i)
+        {
+            n = 1 + (unsigned long)(uniform(&state) * RATES[r] / 1000.0);
+            dx = (n + 1) * dt * (0.9 + 0.2 * uniform(&state));
+
+            pitch_idle_observations(&p, n);
+            step(&ref, n);
+            pitch_dt_observation(&p, dx);
+            pitch_dt_observation(&ref, dx);
+
+            d = divergence(&p, &ref);
+            if (d > worst_chain)
+                worst_chain = d;
+        }
+        if (worst_chain > 1.0)
+        {
+            fprintf(stderr, "idlecheck: %u Hz, decoding: v %.17g/%.17g, x %.17g/%.17g\n",
+                    RATES[r], p.v, ref.v, p.x, ref.x);
+            failed = 1;
+        }
+
+        // of the tolerance
+        printf("%-7u | %11.4f%% | %11.4f%%\n", RATES[r], 100.0 * worst_run,
+               100.0 * worst_chain);
+    }
+
+    printf("%s\n", failed ? "FAILED" : "passed");
+
+    return failed;
+}
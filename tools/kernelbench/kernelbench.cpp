@@ -0,0 +1,162 @@
+//-----------------------------------------------------------------------------
+//@file
+//	kernelbench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Samples decoded per second by the kernels specialised for the flags and
+//	bit width of each timecode definition, against the generic kernels which
+//	read them from the definition. The signal is a scratched record, decoded
+//	in blocks as the module does; both kernels are checked to give the same
+//	position and pitch after every block.
+//
+//	usage: kernelbench [sample rate]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define BLOCK 512     // samples, a usual block of the host
+#define SECONDS 60.0  // of signal
+#define RUNS 5        // best of
+
+// what a decoder reports after a block
+struct report {
+    signed int position;
+    double pitch;
+};
+
+//-----------------------------------------------------------------------------
+// best rate of decoding the whole signal, in samples per second, and what
+// the decoder reported after each block of the last run
+static double time_decode(timecode_def *def, unsigned int rate,
+                          const std::vector<float> &left, const std::vector<float> &right,
+                          std::vector<report> &reports)
+{
+    struct timecoder tc;
+    double best, t;
+    size_t n, blocks;
+    int run;
+
+    blocks = left.size() / BLOCK;
+    reports.resize(blocks);
+
+    best = 0.0;
+    for (run = 0; run < RUNS; ++run)
+    {
+        timecoder_init(&tc, def, 1.0, rate, false);
+
+        t = synth_now();
+        for (n = 0; n < blocks; ++n)
+        {
+            timecoder_submit_planar_float(&tc, &left[n * BLOCK], &right[n * BLOCK], BLOCK);
+            reports[n].position = timecoder_get_position(&tc, NULL);
+            reports[n].pitch = timecoder_get_pitch(&tc);
+        }
+        t = synth_now() - t;
+
+        timecoder_clear(&tc);
+
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    return blocks * BLOCK / best;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<float> left, right;
+    std::vector<report> generic, specialised;
+    unsigned int rate;
+    timecode_def *def;
+    double g, s;
+    size_t n, valid;
+    int i, failed;
+
+    rate = (argc > 1) ? (unsigned int)atoi(argv[1]) : 44100;
+    if (rate == 0)
+    {
+        fprintf(stderr, "usage: kernelbench [sample rate]\n");
+        return 1;
+    }
+
+    failed = 0;
+
+    printf("%-15s %13s %13s %8s %8s\n", "Msamples/s", "generic", "specialised", "speedup", "locked");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_FULL);
+        if (def == NULL)
+        {
+            fprintf(stderr, "kernelbench: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+
+        synth_record(def, rate, SECONDS, true, left, right);
+
+        timecoder_set_generic(true);
+        g = time_decode(def, rate, left, right, generic);
+        timecoder_set_generic(false);
+        s = time_decode(def, rate, left, right, specialised);
+
+        valid = 0;
+        for (n = 0; n < generic.size(); ++n)
+        {
+            if (specialised[n].position != -1)
+                valid++;
+
+            if (generic[n].position != specialised[n].position
+                || generic[n].pitch != specialised[n].pitch)
+            {
+                fprintf(stderr, "kernelbench: %s: kernels differ after block %u\n",
+                        SYNTH_NAMES[i], (unsigned int)n);
+                failed = 1;
+                break;
+            }
+        }
+
+        printf("%-15s %13.1f %13.1f %8.2f %7.1f%%\n", SYNTH_NAMES[i], g / 1e6, s / 1e6, s / g,
+               100.0 * valid / generic.size());
+
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+    }
+
+    return failed;
+}
@@ -0,0 +1,221 @@
+//-----------------------------------------------------------------------------
+//@file
+//	lockbench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Samples from a needle drop to the first valid position, for the lock
+//	after VALID_BITS error checks as xwax and the lock on adjacent lookups.
+//	Half the drops lift the needle for 30 ms, half jump in place; each lands
+//	at a random position and speed of every timecode. Positions reported
+//	after the decoder lost the previous one and more than a few cycles off
+//	the record are counted as false locks.
+//
+//	usage: lockbench [drops] [sample rate]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define BLOCK 64          // samples, small for the resolution of the latency
+#define DEFAULT_DROPS 200
+#define NOISE 0.003       // peak, of a full scale of 1
+#define LIFT 0.030        // seconds, the needle is off the record
+#define SETTLE 0.4        // seconds, played after each drop
+#define MARGIN 3          // cycles, between a valid position and the record
+
+//-----------------------------------------------------------------------------
+// what the decoder did after the drops
+//-----------------------------------------------------------------------------
+struct drops {
+    std::vector<unsigned long> latency; // samples, of the drops it locked on
+    unsigned long never;      // drops it did not lock on
+    unsigned long wrong;      // drops with a false lock
+};
+
+//-----------------------------------------------------------------------------
+static void play(synth *s, timecoder *tc, double seconds, double speed)
+{
+    float left[BLOCK], right[BLOCK];
+    size_t n;
+
+    for (n = (size_t)(seconds * s->rate / BLOCK); n > 0; --n)
+    {
+        synth_play(s, left, right, BLOCK, speed);
+        timecoder_submit_planar_float(tc, left, right, BLOCK);
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void drop(timecode_def *def, unsigned int rate, enum timecoder_lock lock,
+                 int count, drops *d)
+{
+    float left[BLOCK], right[BLOCK];
+    signed int position;
+    double offset, speed, error;
+    bool lost, wrong;
+    unsigned long at, first;
+    size_t n;
+    timecoder tc;
+    synth s;
+    int k;
+
+    synth_init(&s, def, rate);
+    s.noise = NOISE;
+
+    timecoder_init(&tc, def, 1.0, rate, false);
+    timecoder_set_lock(&tc, lock);
+
+    // levels learnt, and the cycles between the position reported and
+    // the one being played
+    play(&s, &tc, 1.0, 1.0);
+    offset = timecoder_get_position(&tc, NULL) - s.position;
+
+    d->latency.clear();
+    d->never = 0;
+    d->wrong = 0;
+
+    for (k = 0; k < count; ++k)
+    {
+        if (k % 2 == 0)
+        {
+            s.level = 0.0;
+            play(&s, &tc, LIFT, 1.0);
+            s.level = 1.0;
+        }
+
+        s.position = 1000.0 + (def->length - 3000) * (synth_random(&s) + 1.0) / 2.0;
+        speed = 1.0 + 0.1 * synth_random(&s);
+
+        lost = wrong = false;
+        first = 0;
+        at = 0;
+        for (n = (size_t)(SETTLE * rate / BLOCK); n > 0; --n)
+        {
+            synth_play(&s, left, right, BLOCK, speed);
+            timecoder_submit_planar_float(&tc, left, right, BLOCK);
+            at += BLOCK;
+
+            position = timecoder_get_position(&tc, NULL);
+            if (position == -1)
+            {
+                lost = true;
+                continue;
+            }
+
+            // the previous position, until the decoder finds it wrong
+            if (!lost)
+                continue;
+
+            error = position - s.position - offset;
+            if (error > MARGIN || error < -MARGIN)
+                wrong = true;
+            else if (first == 0)
+                first = at;
+        }
+
+        if (first == 0)
+            d->never++;
+        else
+            d->latency.push_back(first);
+
+        if (wrong)
+            d->wrong++;
+    }
+
+    timecoder_clear(&tc);
+
+    std::sort(d->latency.begin(), d->latency.end());
+}
+
+//-----------------------------------------------------------------------------
+static void print(const char *name, const char *lock, unsigned int rate, const drops *d)
+{
+    const std::vector<unsigned long> &l = d->latency;
+
+    if (l.empty())
+    {
+        printf("%-15s %-9s %32s %7lu %7lu\n", name, lock, "never", d->never, d->wrong);
+        return;
+    }
+
+    printf("%-15s %-9s %7lu %7lu %7lu %8.1f %7lu %7lu\n", name, lock,
+           l[l.size() / 2], l[l.size() * 9 / 10], l.back(),
+           1000.0 * l[l.size() / 2] / rate, d->never, d->wrong);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    unsigned int rate;
+    timecode_def *def;
+    drops bits, adjacent;
+    int i, count;
+
+    count = (argc > 1) ? atoi(argv[1]) : DEFAULT_DROPS;
+    rate = (argc > 2) ? (unsigned int)atoi(argv[2]) : 44100;
+    if (count <= 0 || rate == 0)
+    {
+        fprintf(stderr, "usage: lockbench [drops] [sample rate]\n");
+        return 1;
+    }
+
+    printf("%-15s %-9s %7s %7s %7s %8s %7s %7s\n", "samples", "lock", "median", "p90", "max",
+           "ms", "no lock", "false");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_FULL);
+        if (def == NULL)
+        {
+            fprintf(stderr, "lockbench: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+
+        drop(def, rate, TIMECODER_LOCK_BITS, count, &bits);
+        drop(def, rate, TIMECODER_LOCK_ADJACENT, count, &adjacent);
+
+        print(SYNTH_NAMES[i], "bits", rate, &bits);
+        print("", "adjacent", rate, &adjacent);
+
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+//-----------------------------------------------------------------------------
+//@file
+//	lutbench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Time of a lookup in the open addressing table of lut.cpp against the
+//	chained hash it replaced, for every timecode definition. Lookups of
+//	codes on the record and of random codes are timed separately, and both
+//	tables are checked to return the same positions.
+//
+//	usage: lutbench [lookups]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../xwax_src/lut.h"
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+
+// the chained hash of the original lut.cpp, the hash being the low bits
+#define CHAIN_HASH_BITS 16
+#define CHAIN_HASH(timecode) ((timecode) & ((1 << CHAIN_HASH_BITS) - 1))
+#define CHAIN_NO_SLOT ((unsigned)-1)
+
+#define DEFAULT_LOOKUPS (1 << 20)
+#define RUNS 3 // best of
+
+//-----------------------------------------------------------------------------
+// chained hash, as lut.cpp was
+//-----------------------------------------------------------------------------
+struct chain_slot {
+    unsigned int timecode;
+    unsigned int next; // next slot with the same hash
+};
+
+struct chain_lut {
+    std::vector<chain_slot> slot;
+    std::vector<unsigned int> table; // hash -> slot lookup
+};
+
+//-----------------------------------------------------------------------------
+static void chain_build(chain_lut *lut, const std::vector<unsigned int> &codes)
+{
+    unsigned int n, hash;
+
+    lut->slot.resize(codes.size());
+    lut->table.assign(1 << CHAIN_HASH_BITS, CHAIN_NO_SLOT);
+
+    for (n = 0; n < codes.size(); ++n)
+    {
+        hash = CHAIN_HASH(codes[n]);
+        lut->slot[n].timecode = codes[n];
+        lut->slot[n].next = lut->table[hash];
+        lut->table[hash] = n;
+    }
+}
+
+//-----------------------------------------------------------------------------
+static unsigned int chain_lookup(const chain_lut *lut, unsigned int timecode)
+{
+    unsigned int slot_no;
+
+    slot_no = lut->table[CHAIN_HASH(timecode)];
+    while (slot_no != CHAIN_NO_SLOT)
+    {
+        if (lut->slot[slot_no].timecode == timecode)
+            return slot_no;
+        slot_no = lut->slot[slot_no].next;
+    }
+
+    return (unsigned)-1;
+}
+
+//-----------------------------------------------------------------------------
+// queries, the same for both tables
+//-----------------------------------------------------------------------------
+static unsigned int xorshift(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+//-----------------------------------------------------------------------------
+// best time of a lookup over all the queries, in ns; the sum of the
+// results keeps the lookups from being optimised away
+template <typename Lookup>
+static double time_lookups(const std::vector<unsigned int> &query, Lookup lookup,
+                           unsigned int *sum)
+{
+    double best, t;
+    size_t n;
+    int run;
+
+    best = 0.0;
+    for (run = 0; run < RUNS; ++run)
+    {
+        t = synth_now();
+        for (n = 0; n < query.size(); ++n)
+            *sum += lookup(query[n]);
+        t = synth_now() - t;
+
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    return best / query.size() * 1e9;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned int> codes, hits, misses;
+    unsigned int state, sum, mask;
+    unsigned long lookups;
+    timecode_def *def;
+    chain_lut chain;
+    struct lut lut;
+    double chain_hit, lut_hit, chain_miss, lut_miss;
+    size_t n;
+    int i, failed;
+
+    lookups = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_LOOKUPS;
+    if (lookups == 0)
+    {
+        fprintf(stderr, "usage: lutbench [lookups]\n");
+        return 1;
+    }
+
+    failed = 0;
+    sum = 0;
+
+    printf("%-15s %9s | %-21s | %-21s\n", "", "", "on the record", "random codes");
+    printf("%-15s %9s | %9s %11s | %9s %11s\n", "timecode", "positions",
+           "chain ns", "open ns", "chain ns", "open ns");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        // only its parameters are used, the sparse table is quick to build
+        def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_SPARSE);
+        if (def == NULL)
+        {
+            fprintf(stderr, "lutbench: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+
+        synth_codes(def, codes);
+        mask = (1u << def->bits) - 1;
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+
+        chain_build(&chain, codes);
+
+        if (lut_init(&lut, (int)codes.size()) == -1)
+            return 1;
+        for (n = 0; n < codes.size(); ++n)
+            lut_push(&lut, codes[n]);
+
+        // positions spread over the record, then any code of the width
+        state = 0x9e3779b9;
+        hits.resize(lookups);
+        misses.resize(lookups);
+        for (n = 0; n < lookups; ++n)
+        {
+            hits[n] = codes[xorshift(&state) % codes.size()];
+            misses[n] = xorshift(&state) & mask;
+        }
+
+        for (n = 0; n < lookups; ++n)
+        {
+            if (lut_lookup(&lut, hits[n]) != chain_lookup(&chain, hits[n])
+                || lut_lookup(&lut, misses[n]) != chain_lookup(&chain, misses[n]))
+            {
+                fprintf(stderr, "lutbench: %s: tables differ on query %u\n",
+                        SYNTH_NAMES[i], (unsigned int)n);
+                failed = 1;
+                break;
+            }
+        }
+
+        chain_hit = time_lookups(hits, [&chain](unsigned int c) {
+            return chain_lookup(&chain, c); }, &sum);
+        lut_hit = time_lookups(hits, [&lut](unsigned int c) {
+            return lut_lookup(&lut, c); }, &sum);
+        chain_miss = time_lookups(misses, [&chain](unsigned int c) {
+            return chain_lookup(&chain, c); }, &sum);
+        lut_miss = time_lookups(misses, [&lut](unsigned int c) {
+            return lut_lookup(&lut, c); }, &sum);
+
+        printf("%-15s %9u | %9.1f %11.1f | %9.1f %11.1f\n", SYNTH_NAMES[i],
+               (unsigned int)codes.size(), chain_hit, lut_hit, chain_miss, lut_miss);
+
+        lut_clear(&lut);
+    }
+
+    // printed so that the lookups are kept
+    printf("(checksum %08x)\n", sum);
+
+    return failed;
+}
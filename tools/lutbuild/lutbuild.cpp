@@ -0,0 +1,146 @@
+//-----------------------------------------------------------------------------
+//@file
+//	lutbuild.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Time to build the full lookup table of every timecode definition on 1 to
+//	N threads, the sequence being split with LFSR jump-ahead. Every table is
+//	checked to give the position of every code of the record.
+//
+//	usage: lutbuild [max threads]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define RUNS 3 // best of
+
+//-----------------------------------------------------------------------------
+// best time to build the table of a definition on the given number of
+// threads, in ms, or -1 if a table was wrong
+static double time_build(const char *name, int nthreads,
+                         const std::vector<unsigned int> &codes)
+{
+    timecode_def *def;
+    double best, t;
+    unsigned int n;
+    int run;
+
+    timecoder_set_build_threads(nthreads);
+
+    best = 0.0;
+    for (run = 0; run < RUNS; ++run)
+    {
+        t = synth_now();
+        def = timecoder_find_definition(name, TIMECODER_LOOKUP_FULL);
+        t = synth_now() - t;
+
+        if (def == NULL)
+            return -1.0;
+
+        for (n = 0; n < codes.size(); ++n)
+        {
+            if (lut_lookup(&def->lut, codes[n]) != n)
+            {
+                fprintf(stderr, "lutbuild: %s on %d threads: wrong position %u\n",
+                        name, nthreads, n);
+                timecoder_release_definition(def);
+                return -1.0;
+            }
+        }
+
+        // dropped, so that the next run builds it again
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    return best * 1000.0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned int> codes;
+    timecode_def *def;
+    double ms, one;
+    int i, threads, maxthreads;
+
+    maxthreads = (argc > 1) ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    if (maxthreads <= 0)
+        maxthreads = 1;
+
+    printf("%-15s", "ms on threads");
+    for (threads = 1; threads <= maxthreads; ++threads)
+        printf(" %7d", threads);
+    printf("  speedup\n");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        // only its parameters are used, the sparse table is quick to build
+        def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_SPARSE);
+        if (def == NULL)
+        {
+            fprintf(stderr, "lutbuild: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+        synth_codes(def, codes);
+        timecoder_release_definition(def);
+        timecoder_free_lookup();
+
+        printf("%-15s", SYNTH_NAMES[i]);
+        one = 0.0;
+        ms = 0.0;
+        for (threads = 1; threads <= maxthreads; ++threads)
+        {
+            ms = time_build(SYNTH_NAMES[i], threads, codes);
+            if (ms < 0.0)
+                return 1;
+            if (threads == 1)
+                one = ms;
+            printf(" %7.1f", ms);
+            fflush(stdout);
+        }
+        printf("  %7.2f\n", one / ms);
+    }
+
+    return 0;
+}
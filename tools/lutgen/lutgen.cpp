@@ -0,0 +1,99 @@
+//-----------------------------------------------------------------------------
+//@file  
+//	lutgen.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief 
+//	Build time generator of the timecode lookup tables. Writes one .lut file
+//	per timecode definition, in the format mapped by the xwax lut code, to be
+//	linked into the WaxDecoder module as resources (see WaxDecoderLuts.rc).
+//
+//	usage: lutgen <output folder>
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+
+#include "../../xwax_src/timecoder.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+
+// timecodes linked into the module, as TC_NAMES in WaxDecoder.h
+static const char * const TC_NAMES[7] = {
+    "serato_2a",
+    "serato_2b",
+    "serato_cd",
+    "traktor_a",
+    "traktor_b",
+    "mixvibes_v2",
+    "mixvibes_7inch"
+};
+
+//-----------------------------------------------------------------------------
+// the lut cache of the timecoder writes the files, which are checked after
+int main(int argc, char *argv[])
+{
+    char path[FILENAME_MAX];
+    timecode_def *def;
+    FILE *f;
+    int i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: lutgen <output folder>\n");
+        return 1;
+    }
+
+    timecoder_set_cache_dir(argv[1]);
+
+    for (i = 0; i < 7; ++i)
+    {
+        def = timecoder_find_definition(TC_NAMES[i], TIMECODER_LOOKUP_FULL);
+        if (def == NULL)
+        {
+            fprintf(stderr, "lutgen: cannot build %s\n", TC_NAMES[i]);
+            return 1;
+        }
+        timecoder_release_definition(def);
+
+        snprintf(path, sizeof path, "%s/%s.lut", argv[1], TC_NAMES[i]);
+        f = fopen(path, "rb");
+        if (f == NULL)
+        {
+            fprintf(stderr, "lutgen: cannot write %s\n", path);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+//-----------------------------------------------------------------------------
+//@file
+//	poolbench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Decks decoded in real time per core by the deck pool, against the same
+//	decks decoded one after the other on the calling thread, at 48 and 96 kHz.
+//	Each deck plays a scratched record of one of the timecodes, pushed in
+//	blocks as the host does; the last result of every deck in the pool is
+//	checked to be the one of its decoder on the calling thread.
+//
+//	usage: poolbench [workers] [decks]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include "../../xwax_src/deckpool.h"
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define BLOCK 512     // samples, a usual block of the host
+#define SECONDS 5.0   // of signal, for each deck
+
+static const unsigned int RATES[] = { 48000, 96000 };
+
+//-----------------------------------------------------------------------------
+// the record played by each deck, one per timecode
+//-----------------------------------------------------------------------------
+struct record {
+    timecode_def *def;
+    std::vector<float> left, right;
+};
+
+//-----------------------------------------------------------------------------
+// seconds to decode every deck on the calling thread, block by block
+static double time_single(std::vector<timecoder> &tc, const std::vector<record> &rec,
+                          unsigned int rate, size_t n)
+{
+    size_t d, at;
+    double t;
+
+    for (d = 0; d < tc.size(); ++d)
+        timecoder_init(&tc[d], rec[d % rec.size()].def, 1.0, rate, false);
+
+    t = synth_now();
+    for (at = 0; at < n; at += BLOCK)
+    {
+        for (d = 0; d < tc.size(); ++d)
+        {
+            const record &r = rec[d % rec.size()];
+            timecoder_submit_planar_float(&tc[d], &r.left[at], &r.right[at], BLOCK);
+        }
+    }
+
+    return synth_now() - t;
+}
+
+//-----------------------------------------------------------------------------
+// seconds to decode every deck on the pool, from the first block pushed to
+// the last sample decoded, or -1 if the pool could not be started
+static double time_pool(struct deckpool *p, const std::vector<record> &rec,
+                        unsigned int rate, size_t n)
+{
+    struct deckpool_result r;
+    unsigned int d;
+    size_t at;
+    bool done;
+    double t;
+
+    for (d = 0; d < p->decks; ++d)
+        timecoder_init(deckpool_deck(p, d), rec[d % rec.size()].def, 1.0, rate, false);
+
+    if (deckpool_start(p) != 0)
+        return -1.0;
+
+    t = synth_now();
+    for (at = 0; at < n; at += BLOCK)
+    {
+        for (d = 0; d < p->decks; ++d)
+        {
+            const record &k = rec[d % rec.size()];
+            deckpool_push(p, d, &k.left[at], &k.right[at], BLOCK);
+        }
+    }
+
+    do {
+        done = true;
+        for (d = 0; d < p->decks; ++d)
+        {
+            if (!deckpool_result(p, d, &r) || r.samples + r.dropped < n)
+                done = false;
+        }
+        if (!done)
+            std::this_thread::yield();
+    } while (!done);
+    t = synth_now() - t;
+
+    return t;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<record> rec(SYNTH_TIMECODES);
+    std::vector<timecoder> tc;
+    struct deckpool_result r;
+    struct deckpool pool;
+    unsigned int rate, workers, decks, cores, d;
+    unsigned long long dropped;
+    double single, pooled, when;
+    size_t n, i;
+    int k, failed;
+
+    cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+        cores = 1;
+
+    workers = (argc > 1) ? (unsigned int)atoi(argv[1]) : cores;
+    decks = (argc > 2) ? (unsigned int)atoi(argv[2]) : 4 * workers;
+    if (workers == 0 || decks == 0)
+    {
+        fprintf(stderr, "usage: poolbench [workers] [decks]\n");
+        return 1;
+    }
+
+    // a worker beyond the cores shares one with another
+    if (cores > workers)
+        cores = workers;
+
+    failed = 0;
+    tc.resize(decks);
+
+    printf("%u decks on %u workers, %u cores; decks decoded in real time\n",
+           decks, workers, cores);
+    printf("%-6s | %14s | %14s %14s %8s\n", "rate", "one thread",
+           "pool", "pool per core", "dropped");
+
+    for (i = 0; i < sizeof(RATES) / sizeof(RATES[0]); ++i)
+    {
+        rate = RATES[i];
+
+        for (k = 0; k < SYNTH_TIMECODES; ++k)
+        {
+            rec[k].def = timecoder_find_definition(SYNTH_NAMES[k], TIMECODER_LOOKUP_FULL);
+            if (rec[k].def == NULL)
+            {
+                fprintf(stderr, "poolbench: no definition %s\n", SYNTH_NAMES[k]);
+                return 1;
+            }
+            synth_record(rec[k].def, rate, SECONDS, true, rec[k].left, rec[k].right);
+        }
+
+        n = rec[0].left.size();
+        n -= n % BLOCK;
+
+        // the whole signal fits, so that the host never waits on a worker
+        if (deckpool_init(&pool, decks, workers, n) != 0)
+        {
+            fprintf(stderr, "poolbench: not enough memory for %u decks\n", decks);
+            return 1;
+        }
+
+        single = time_single(tc, rec, rate, n);
+        pooled = time_pool(&pool, rec, rate, n);
+        if (pooled < 0.0)
+        {
+            fprintf(stderr, "poolbench: the pool could not be started\n");
+            return 1;
+        }
+
+        dropped = 0;
+        for (d = 0; d < decks; ++d)
+        {
+            deckpool_result(&pool, d, &r);
+            dropped += r.dropped;
+            if (r.position != timecoder_get_position(&tc[d], &when) || r.when != when
+                || r.pitch != timecoder_get_pitch(&tc[d]) || r.dropped != 0)
+            {
+                fprintf(stderr, "poolbench: deck %u differs from its decoder at %u Hz\n",
+                        d, rate);
+                failed = 1;
+            }
+        }
+
+        deckpool_stop(&pool);
+
+        // decks decoded in real time, each needing n samples of the rate
+        printf("%-6u | %14.1f | %14.1f %14.1f %8llu\n", rate,
+               decks * (double)n / rate / single,
+               decks * (double)n / rate / pooled,
+               decks * (double)n / rate / pooled / cores, dropped);
+
+        for (d = 0; d < decks; ++d)
+        {
+            timecoder_clear(deckpool_deck(&pool, d));
+            timecoder_clear(&tc[d]);
+        }
+        deckpool_clear(&pool);
+
+        for (k = 0; k < SYNTH_TIMECODES; ++k)
+            timecoder_release_definition(rec[k].def);
+        timecoder_free_lookup();
+    }
+
+    return failed;
+}
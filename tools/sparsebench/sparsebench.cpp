@@ -0,0 +1,181 @@
+//-----------------------------------------------------------------------------
+//@file
+//	sparsebench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	Time of a position lookup and memory of the table, for the full lookup
+//	table of every timecode definition against the compact one which only
+//	holds every stride-th position. Lookups of codes on the record and of
+//	random codes are timed separately, and both tables are checked to return
+//	the same positions.
+//
+//	usage: sparsebench [lookups]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../xwax_src/lut.h"
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define DEFAULT_LOOKUPS (1 << 14) // a compact lookup steps the LFSR up to a stride
+#define RUNS 3 // best of
+
+//-----------------------------------------------------------------------------
+// queries, the same for both tables
+//-----------------------------------------------------------------------------
+static unsigned int xorshift(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+//-----------------------------------------------------------------------------
+// best time of a lookup over all the queries, in ns; the sum of the
+// results keeps the lookups from being optimised away
+static double time_lookups(timecode_def *def, const std::vector<unsigned int> &query,
+                           unsigned int *sum)
+{
+    double best, t;
+    size_t n;
+    int run;
+
+    best = 0.0;
+    for (run = 0; run < RUNS; ++run)
+    {
+        t = synth_now();
+        for (n = 0; n < query.size(); ++n)
+            *sum += timecoder_find_position(def, query[n]);
+        t = synth_now() - t;
+
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    return best / query.size() * 1e9;
+}
+
+//-----------------------------------------------------------------------------
+// memory of the table of a definition, in Kb
+static double table_kb(const timecode_def *def)
+{
+    return def->lut.nbuckets * sizeof(struct bucket) / 1024.0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned int> codes, hits, misses;
+    unsigned int state, sum, mask;
+    unsigned long lookups;
+    timecode_def *full, *sparse;
+    double full_hit, sparse_hit, full_miss, sparse_miss;
+    size_t n;
+    int i, failed;
+
+    lookups = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_LOOKUPS;
+    if (lookups == 0)
+    {
+        fprintf(stderr, "usage: sparsebench [lookups]\n");
+        return 1;
+    }
+
+    failed = 0;
+    sum = 0;
+
+    printf("%-15s %9s | %-21s | %-21s | %-21s\n", "", "", "table Kb", "on the record",
+           "random codes");
+    printf("%-15s %9s | %9s %11s | %9s %11s | %9s %11s\n", "timecode", "positions",
+           "full", "compact", "full ns", "compact ns", "full ns", "compact ns");
+
+    for (i = 0; i < SYNTH_TIMECODES; ++i)
+    {
+        full = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_FULL);
+        sparse = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_SPARSE);
+        if (full == NULL || sparse == NULL)
+        {
+            fprintf(stderr, "sparsebench: no definition %s\n", SYNTH_NAMES[i]);
+            return 1;
+        }
+
+        synth_codes(full, codes);
+        mask = (1u << full->bits) - 1;
+
+        // positions spread over the record, then any code of the width
+        state = 0x9e3779b9;
+        hits.resize(lookups);
+        misses.resize(lookups);
+        for (n = 0; n < lookups; ++n)
+        {
+            hits[n] = codes[xorshift(&state) % codes.size()];
+            misses[n] = xorshift(&state) & mask;
+        }
+
+        for (n = 0; n < lookups; ++n)
+        {
+            if (timecoder_find_position(full, hits[n]) != timecoder_find_position(sparse, hits[n])
+                || timecoder_find_position(full, misses[n])
+                   != timecoder_find_position(sparse, misses[n]))
+            {
+                fprintf(stderr, "sparsebench: %s: tables differ on query %u\n",
+                        SYNTH_NAMES[i], (unsigned int)n);
+                failed = 1;
+                break;
+            }
+        }
+
+        full_hit = time_lookups(full, hits, &sum);
+        sparse_hit = time_lookups(sparse, hits, &sum);
+        full_miss = time_lookups(full, misses, &sum);
+        sparse_miss = time_lookups(sparse, misses, &sum);
+
+        printf("%-15s %9u | %9.0f %11.1f | %9.1f %11.1f | %9.1f %11.1f\n", SYNTH_NAMES[i],
+               (unsigned int)codes.size(), table_kb(full), table_kb(sparse),
+               full_hit, sparse_hit, full_miss, sparse_miss);
+
+        timecoder_release_definition(full);
+        timecoder_release_definition(sparse);
+        timecoder_free_lookup();
+    }
+
+    // printed so that the lookups are kept
+    printf("(checksum %08x)\n", sum);
+
+    return failed;
+}
@@ -0,0 +1,277 @@
+//-----------------------------------------------------------------------------
+//@file
+//	zerobench.cpp
+//
+//@author
+//	Arnaud BEUROTTE aka 'naarud'
+//
+//@brief
+//	The zero/rumble filter of the timecoder in Q32 fixed point, against the
+//	double precision filter it replaced, at the usual sample rates. Both are
+//	fed the samples of every timecode played with noise and scratched:
+//	- exactness: steps where they differ from the same previous zero, and
+//	  samples where they differ when each runs on its own
+//	- throughput: stereo frames filtered per second
+//
+//	usage: zerobench [seconds]
+//
+//@LICENCE
+//
+// Copyright (c) 2012, 2018 Arnaud BEUROTTE
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// includes
+//-----------------------------------------------------------------------------
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/synth.h"
+
+//-----------------------------------------------------------------------------
+// defines and constantes
+//-----------------------------------------------------------------------------
+#define ZERO_RC 0.001       // time constant of the filter, as in timecoder.cpp
+#define DEFAULT_SECONDS 10.0 // of signal, for each timecode
+#define NOISE 0.01          // peak, of a full scale of 1
+#define RUNS 5              // best of
+
+static const unsigned int RATES[] = { 44100, 48000, 96000 };
+
+//-----------------------------------------------------------------------------
+// the filters
+//-----------------------------------------------------------------------------
+
+// double precision, as detect_zero_crossing was; the difference is taken
+// in double so that a full scale step does not overflow
+static inline signed int zero_double(signed int zero, signed int v, double alpha)
+{
+    return (signed int)(zero + alpha * ((double)v - zero));
+}
+
+//-----------------------------------------------------------------------------
+// Q32 fixed point, as zero_filter in timecoder.cpp
+static inline signed int zero_fixed(signed int zero, signed int v, unsigned int coeff)
+{
+    signed int d;
+    long long s;
+
+    d = (signed int)((unsigned int)v - (unsigned int)zero);
+    s = (long long)zero * 4294967296LL + (long long)d * coeff;
+    if (s < 0)
+        s += 0xffffffffLL;
+
+    return (signed int)(s >> 32);
+}
+
+//-----------------------------------------------------------------------------
+// a sample of the deck as the timecoder reads it, as planar_float in
+// timecoder.cpp
+static inline signed int sample(float x)
+{
+    x *= 2147483648.0f;
+
+    if (x >= 2147483648.0f)
+        return INT_MAX;
+    if (x <= -2147483648.0f)
+        return INT_MIN;
+    if (x != x)
+        return 0;
+
+    return (signed int)x;
+}
+
+//-----------------------------------------------------------------------------
+// what both filters did on a signal
+//-----------------------------------------------------------------------------
+struct exactness {
+    unsigned long long steps;
+    unsigned long long mismatches; // steps from the same previous zero
+    unsigned int max_error;        // LSB, of a step
+    unsigned long long off;        // samples, running on their own
+    unsigned int max_drift;        // LSB, running on their own
+};
+
+//-----------------------------------------------------------------------------
+static void compare(const std::vector<signed int> &x, double alpha, unsigned int coeff,
+                    exactness *e)
+{
+    signed int zd, zq, nd, nq;
+    unsigned int err;
+    size_t n;
+
+    zd = zq = 0;
+    for (n = 0; n < x.size(); ++n)
+    {
+        // in lockstep, from the zero of the double filter
+        nd = zero_double(zd, x[n], alpha);
+        nq = zero_fixed(zd, x[n], coeff);
+        err = (unsigned int)abs(nd - nq);
+        if (err != 0)
+        {
+            e->mismatches++;
+            if (err > e->max_error)
+                e->max_error = err;
+        }
+        zd = nd;
+
+        // on its own
+        zq = zero_fixed(zq, x[n], coeff);
+        err = (unsigned int)abs(zq - zd);
+        if (err != 0)
+        {
+            e->off++;
+            if (err > e->max_drift)
+                e->max_drift = err;
+        }
+
+        e->steps++;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// best rate of filtering both channels, in frames per second; the sum of
+// the zeros keeps the filter from being optimised away
+template <typename Filter>
+static double time_filter(const std::vector<signed int> &left, const std::vector<signed int> &right,
+                          Filter filter, long long *sum)
+{
+    signed int zl, zr;
+    double best, t;
+    size_t n;
+    int run;
+
+    best = 0.0;
+    for (run = 0; run < RUNS; ++run)
+    {
+        zl = zr = 0;
+
+        t = synth_now();
+        for (n = 0; n < left.size(); ++n)
+        {
+            zl = filter(zl, left[n]);
+            zr = filter(zr, right[n]);
+            *sum += zl - zr;
+        }
+        t = synth_now() - t;
+
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    return left.size() / best;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::vector<float> fl, fr;
+    std::vector<signed int> left, right;
+    unsigned int rate, coeff;
+    timecode_def *def;
+    double seconds, dt, alpha, d, q, td, tq;
+    exactness e;
+    long long sum;
+    size_t n, r, frames;
+    synth s;
+    int i;
+
+    seconds = (argc > 1) ? atof(argv[1]) : DEFAULT_SECONDS;
+    if (seconds <= 0.0)
+    {
+        fprintf(stderr, "usage: zerobench [seconds]\n");
+        return 1;
+    }
+
+    sum = 0;
+
+    printf("%-6s | %11s %9s %5s | %9s %9s | %10s %10s %8s\n", "rate", "steps",
+           "mismatch", "max", "off", "max drift", "double M/s", "Q32 M/s", "speedup");
+
+    for (r = 0; r < sizeof(RATES) / sizeof(RATES[0]); ++r)
+    {
+        rate = RATES[r];
+
+        // the coefficients, as timecoder_init computes them
+        dt = 1.0 / rate;
+        alpha = dt / (ZERO_RC + dt);
+        coeff = (unsigned int)(alpha * 4294967296.0 + 0.5);
+
+        e = exactness();
+        td = tq = 0.0;
+        frames = 0;
+
+        for (i = 0; i < SYNTH_TIMECODES; ++i)
+        {
+            // only its parameters are used, the sparse table is quick to build
+            def = timecoder_find_definition(SYNTH_NAMES[i], TIMECODER_LOOKUP_SPARSE);
+            if (def == NULL)
+            {
+                fprintf(stderr, "zerobench: no definition %s\n", SYNTH_NAMES[i]);
+                return 1;
+            }
+
+            synth_init(&s, def, rate);
+            s.noise = NOISE;
+
+            fl.resize((size_t)(seconds * rate));
+            fr.resize(fl.size());
+            for (n = 0; n < fl.size(); ++n)
+                synth_play(&s, &fl[n], &fr[n], 1, synth_scratch((double)n / rate));
+
+            timecoder_release_definition(def);
+            timecoder_free_lookup();
+
+            left.resize(fl.size());
+            right.resize(fr.size());
+            for (n = 0; n < fl.size(); ++n)
+            {
+                left[n] = sample(fl[n]);
+                right[n] = sample(fr[n]);
+            }
+
+            compare(left, alpha, coeff, &e);
+            compare(right, alpha, coeff, &e);
+
+            d = time_filter(left, right, [alpha](signed int z, signed int v) {
+                return zero_double(z, v, alpha); }, &sum);
+            q = time_filter(left, right, [coeff](signed int z, signed int v) {
+                return zero_fixed(z, v, coeff); }, &sum);
+
+            // summed as times, so that the rates are over every timecode
+            td += left.size() / d;
+            tq += left.size() / q;
+            frames += left.size();
+        }
+
+        printf("%-6u | %11llu %8.4f%% %5u | %8.4f%% %9u | %10.1f %10.1f %8.2f\n", rate,
+               e.steps, 100.0 * e.mismatches / e.steps, e.max_error,
+               100.0 * e.off / e.steps, e.max_drift,
+               frames / td / 1e6, frames / tq / 1e6, td / tq);
+    }
+
+    // printed so that the filters are kept
+    printf("(checksum %016llx)\n", (unsigned long long)sum);
+
+    return 0;
+}
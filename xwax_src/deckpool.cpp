@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2018 Mark Hills <mark@xwax.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "deckpool.h"
+
+#define CACHE_LINE 64
+
+#define IDLE_WAIT 1 /* ms, bounds a wakeup lost to the host */
+
+/* One side of a ring or result is written by the host and the other
+ * by a worker; each sits on its own cache line */
+
+struct deckpool_deck {
+    struct timecoder tc;
+    float *left, *right;
+    size_t size; /* power of two */
+
+    char pad0[CACHE_LINE];
+    std::atomic<size_t> head; /* written by the host */
+    std::atomic<unsigned long long> dropped;
+
+    char pad1[CACHE_LINE];
+    std::atomic<size_t> tail; /* written by the worker */
+
+    /* Result, odd seq while the worker updates it */
+
+    char pad2[CACHE_LINE];
+    std::atomic<unsigned int> seq;
+    std::atomic<signed int> position;
+    std::atomic<double> when, pitch;
+    std::atomic<unsigned long long> samples;
+    char pad3[CACHE_LINE];
+};
+
+struct deckpool_worker {
+    std::thread thread;
+    unsigned int index;
+    std::atomic<bool> pending, quit;
+    std::mutex mutex;
+    std::condition_variable wake;
+};
+
+/*
+ * Keep the calling thread on one processor
+ */
+
+static void pin(unsigned int cpu)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(),
+                          (DWORD_PTR)1 << (cpu % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+#else
+    (void)cpu;
+#endif
+}
+
+/*
+ * Make the latest state of the decoder of a deck visible to the host
+ */
+
+static void publish(struct deckpool_deck *k, size_t n)
+{
+    unsigned int seq;
+    signed int position;
+    double when = 0.0;
+
+    position = timecoder_get_position(&k->tc, &when);
+
+    seq = k->seq.load(std::memory_order_relaxed);
+    k->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    k->position.store(position, std::memory_order_relaxed);
+    k->when.store(when, std::memory_order_relaxed);
+    k->pitch.store(timecoder_get_pitch(&k->tc), std::memory_order_relaxed);
+    k->samples.store(k->samples.load(std::memory_order_relaxed) + n,
+                     std::memory_order_relaxed);
+
+    k->seq.store(seq + 2, std::memory_order_release);
+}
+
+/*
+ * Decode what the host has queued for a deck
+ *
+ * Return: true if there was anything to decode
+ */
+
+static bool decode(struct deckpool_deck *k)
+{
+    size_t head, tail, start;
+
+    head = k->head.load(std::memory_order_acquire);
+    tail = k->tail.load(std::memory_order_relaxed);
+    if (head == tail)
+        return false;
+
+    start = tail;
+    while (tail != head) {
+        size_t at, n;
+
+        at = tail & (k->size - 1);
+        n = head - tail;
+        if (n > k->size - at)
+            n = k->size - at;
+
+        timecoder_submit_planar_float(&k->tc, k->left + at, k->right + at, n);
+        tail += n;
+        k->tail.store(tail, std::memory_order_release);
+    }
+
+    publish(k, head - start);
+    return true;
+}
+
+/*
+ * Body of a worker: decode its decks until there is nothing queued,
+ * then sleep until the host queues more
+ */
+
+static void work(struct deckpool *p, struct deckpool_worker *w)
+{
+    unsigned int cpus;
+
+    /* Left to the scheduler when the number of cores is not known */
+
+    cpus = std::thread::hardware_concurrency();
+    if (cpus > 0)
+        pin(w->index % cpus);
+
+    while (!w->quit.load(std::memory_order_acquire)) {
+        unsigned int d;
+        bool busy;
+
+        busy = false;
+        for (d = w->index; d < p->decks; d += p->workers)
+            busy |= decode(&p->deck[d]);
+
+        if (busy)
+            continue;
+
+        /* The host signals without the lock, so a wakeup can fall
+         * between the test and the wait; the timeout bounds it */
+
+        std::unique_lock<std::mutex> lock(w->mutex);
+        w->wake.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT), [w] {
+            return w->pending.exchange(false) || w->quit.load();
+        });
+    }
+}
+
+/*
+ * Prepare a pool of workers for the given number of decks, each able
+ * to queue capacity samples
+ *
+ * The decoder of each deck is then set up with timecoder_init() on
+ * deckpool_deck(), and cleared by the caller after the pool.
+ *
+ * Return: -1 if not enough memory could be allocated, otherwise 0
+ */
+
+int deckpool_init(struct deckpool *p, unsigned int decks,
+                  unsigned int workers, size_t capacity)
+{
+    unsigned int d, w;
+    size_t size;
+
+    assert(decks > 0);
+    assert(workers > 0);
+
+    if (workers > decks)
+        workers = decks;
+
+    for (size = 1; size < capacity; size <<= 1);
+
+    p->decks = decks;
+    p->workers = workers;
+    p->running = false;
+    p->deck = new (std::nothrow) struct deckpool_deck[decks](); /* rings NULL */
+    p->worker = new (std::nothrow) struct deckpool_worker[workers];
+
+    if (p->deck == NULL || p->worker == NULL) {
+        perror("new");
+        goto fail;
+    }
+
+    for (d = 0; d < decks; d++) {
+        struct deckpool_deck *k = &p->deck[d];
+
+        memset(&k->tc, 0, sizeof k->tc);
+        k->size = size;
+        k->left = (float*)malloc(sizeof(float) * size);
+        k->right = (float*)malloc(sizeof(float) * size);
+        if (k->left == NULL || k->right == NULL) {
+            perror("malloc");
+            goto fail;
+        }
+    }
+
+    for (w = 0; w < workers; w++)
+        p->worker[w].index = w;
+
+    return 0;
+
+fail:
+    deckpool_clear(p);
+    return -1;
+}
+
+/*
+ * Stop the workers and clear resources associated with a pool
+ */
+
+void deckpool_clear(struct deckpool *p)
+{
+    unsigned int d;
+
+    if (p->running)
+        deckpool_stop(p);
+
+    if (p->deck != NULL) {
+        for (d = 0; d < p->decks; d++) {
+            free(p->deck[d].left);
+            free(p->deck[d].right);
+        }
+    }
+
+    delete[] p->deck;
+    delete[] p->worker;
+    p->deck = NULL;
+    p->worker = NULL;
+}
+
+/*
+ * The decoder of one deck; only to be used while the pool is stopped
+ */
+
+struct timecoder* deckpool_deck(struct deckpool *p, unsigned int d)
+{
+    assert(!p->running);
+    assert(d < p->decks);
+    return &p->deck[d].tc;
+}
+
+/*
+ * Start the workers on empty rings
+ *
+ * Return: 0 on success
+ */
+
+int deckpool_start(struct deckpool *p)
+{
+    unsigned int d, w;
+
+    assert(!p->running);
+
+    for (d = 0; d < p->decks; d++) {
+        struct deckpool_deck *k = &p->deck[d];
+
+        k->head.store(0);
+        k->tail.store(0);
+        k->dropped.store(0);
+        k->seq.store(0);
+        k->position.store(-1);
+        k->when.store(0.0);
+        k->pitch.store(0.0);
+        k->samples.store(0);
+    }
+
+    for (w = 0; w < p->workers; w++) {
+        struct deckpool_worker *k = &p->worker[w];
+
+        k->pending.store(false);
+        k->quit.store(false);
+        k->thread = std::thread(work, p, k);
+    }
+
+    p->running = true;
+    return 0;
+}
+
+/*
+ * Stop the workers; samples still queued are not decoded
+ */
+
+void deckpool_stop(struct deckpool *p)
+{
+    unsigned int w;
+
+    assert(p->running);
+
+    for (w = 0; w < p->workers; w++) {
+        struct deckpool_worker *k = &p->worker[w];
+
+        {
+            std::lock_guard<std::mutex> lock(k->mutex);
+            k->quit.store(true, std::memory_order_release);
+        }
+        k->wake.notify_one();
+    }
+
+    for (w = 0; w < p->workers; w++)
+        p->worker[w].thread.join();
+
+    p->running = false;
+}
+
+/*
+ * Queue a block of audio for one deck, given as one float buffer per
+ * channel; called from the host only, and never waits
+ *
+ * Return: the number of samples queued, fewer if the ring was full
+ */
+
+size_t deckpool_push(struct deckpool *p, unsigned int d,
+                     const float *left, const float *right, size_t n)
+{
+    struct deckpool_deck *k = &p->deck[d];
+    struct deckpool_worker *w = &p->worker[d % p->workers];
+    size_t head, space, at, first;
+
+    head = k->head.load(std::memory_order_relaxed);
+    space = k->size - (head - k->tail.load(std::memory_order_acquire));
+
+    if (n > space) {
+        k->dropped.store(k->dropped.load(std::memory_order_relaxed) + n - space,
+                         std::memory_order_relaxed);
+        n = space;
+    }
+
+    at = head & (k->size - 1);
+    first = n < k->size - at ? n : k->size - at;
+
+    memcpy(k->left + at, left, sizeof(float) * first);
+    memcpy(k->right + at, right, sizeof(float) * first);
+    memcpy(k->left, left + first, sizeof(float) * (n - first));
+    memcpy(k->right, right + first, sizeof(float) * (n - first));
+
+    k->head.store(head + n, std::memory_order_release);
+
+    if (!w->pending.exchange(true))
+        w->wake.notify_one();
+
+    return n;
+}
+
+/*
+ * Read the latest result of one deck; called from the host only, and
+ * never waits
+ *
+ * Return: false if the worker was publishing throughout, in which case
+ * the caller keeps its previous result
+ */
+
+bool deckpool_result(struct deckpool *p, unsigned int d,
+                     struct deckpool_result *r)
+{
+    struct deckpool_deck *k = &p->deck[d];
+    int tries;
+
+    for (tries = 0; tries < 4; tries++) {
+        unsigned int seq;
+
+        seq = k->seq.load(std::memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        r->position = k->position.load(std::memory_order_relaxed);
+        r->when = k->when.load(std::memory_order_relaxed);
+        r->pitch = k->pitch.load(std::memory_order_relaxed);
+        r->samples = k->samples.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (k->seq.load(std::memory_order_relaxed) == seq) {
+            r->dropped = k->dropped.load(std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 Mark Hills <mark@xwax.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef DECKPOOL_H
+#define DECKPOOL_H
+
+#include <stddef.h>
+
+#include "timecoder.h"
+
+// MODS decoding of many decks on a pool of worker threads. The host
+// only copies audio into a ring per deck and reads back the latest
+// result of each deck; neither call waits on a worker.
+
+struct deckpool_deck;
+struct deckpool_worker;
+
+struct deckpool {
+    unsigned int decks, workers;
+    struct deckpool_deck *deck; /* deck d is decoded by worker d % workers */
+    struct deckpool_worker *worker;
+    bool running;
+};
+
+/* The decoder of a deck after the last block it decoded */
+
+struct deckpool_result {
+    signed int position; /* as timecoder_get_position() */
+    double when, pitch;
+    unsigned long long samples; /* decoded since the pool started */
+    unsigned long long dropped; /* lost to a full ring */
+};
+
+int deckpool_init(struct deckpool *p, unsigned int decks,
+                  unsigned int workers, size_t capacity);
+void deckpool_clear(struct deckpool *p);
+
+struct timecoder* deckpool_deck(struct deckpool *p, unsigned int d);
+int deckpool_start(struct deckpool *p);
+void deckpool_stop(struct deckpool *p);
+
+size_t deckpool_push(struct deckpool *p, unsigned int d,
+                     const float *left, const float *right, size_t n);
+bool deckpool_result(struct deckpool *p, unsigned int d,
+                     struct deckpool_result *r);
+
+#endif
@@ -17,51 +17,95 @@
  *
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <thread>
+#include <vector>
 
 #include "lut.h"
 
-/* The number of bits to form the hash, which governs the overall size
- * of the hash lookup table, and hence the amount of chaining */
+// MODS open addressing replaces the HASH_BITS chained hash, see lut.h
+
+/* Average number of used slots per bucket, which governs the overall
+ * size of the table, and hence the amount of probing into the
+ * following buckets */
+
+#define BUCKET_FILL 6
+
+#define CACHE_LINE 64
 
-#define HASH_BITS 16
+/* Fibonacci hashing spreads the LFSR codes, then the 32-bit hash is
+ * scaled onto the bucket range without a modulo */
+
+#define HASH(timecode) ((unsigned int)(timecode) * 0x9e3779b1u)
+#define HOME(lut, timecode) \
+    ((unsigned int)(((unsigned long long)HASH(timecode) * (lut)->nbuckets) >> 32))
 
-#define HASH(timecode) ((timecode) & ((1 << HASH_BITS) - 1))
 #define NO_SLOT ((unsigned)-1)
 
+/* Lookup table file: a header, the key, then the buckets exactly as
+ * they are laid out in memory, starting on a cache line. Bump the
+ * version whenever the bucket layout or the hash changes. */
+
+#define LUT_FILE_MAGIC "xwaxlut"
+#define LUT_FILE_VERSION 1
+#define LUT_FILE_ENDIAN 0x01020304
+
+struct lut_file {
+    char magic[8];
+    unsigned int version,
+        endian, /* catches a file copied across architectures */
+        bucket_slots,
+        key_len,
+        nbuckets,
+        avail,
+        checksum; /* of the buckets */
+};
+
+#define BUCKETS_OFFSET(key_len) \
+    ((sizeof(struct lut_file) + (key_len) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
 
 /* Initialise an empty hash lookup table to store the given number
  * of timecode -> position lookups */
 
 int lut_init(struct lut *lut, int nslots)
 {
-    int n, hashes;
     size_t bytes;
 
-    hashes = 1 << HASH_BITS;
-    bytes = sizeof(struct slot) * nslots + sizeof(slot_no_t) * hashes;
+    lut->nbuckets = nslots / BUCKET_FILL + 1;
+    bytes = sizeof(struct bucket) * lut->nbuckets;
 
-    fprintf(stderr, "Lookup table has %d hashes to %d slots"
-            " (%d slots per hash, %zuKb)\n",
-            hashes, nslots, nslots / hashes, bytes / 1024);
+    fprintf(stderr, "Lookup table has %u buckets to %d slots"
+            " (%d slots per bucket, %zuKb)\n",
+            lut->nbuckets, nslots, BUCKET_FILL, bytes / 1024);
 
-	lut->slot = (slot*) malloc(sizeof(struct slot) * nslots);
-	// MODS lut->slot = malloc(sizeof(struct slot) * nslots);
-	if (lut->slot == NULL) {
+    lut->mem = malloc(bytes + CACHE_LINE - 1);
+    if (lut->mem == NULL) {
         perror("malloc");
         return -1;
     }
 
-	lut->table = (unsigned int*) malloc(sizeof(slot_no_t) * hashes);
-	// MODS lut->table = malloc(sizeof(slot_no_t) * hashes);
-	if (lut->table == NULL) {
-        perror("malloc");
-        return -1;
-    }
+    lut->bucket = (struct bucket*)
+        (((size_t)lut->mem + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+    lut->map = NULL;
 
-    for (n = 0; n < hashes; n++)
-        lut->table[n] = NO_SLOT;
+    memset(lut->bucket, 0xff, bytes); /* all slots NO_SLOT */
 
     lut->avail = 0;
 
@@ -69,45 +113,420 @@ int lut_init(struct lut *lut, int nslots)
 }
 
 
+static void unmap(void *base, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+
 void lut_clear(struct lut *lut)
 {
-    free(lut->table);
-    free(lut->slot);
+    if (lut->map != NULL)
+        unmap(lut->map, lut->map_size);
+    else
+        free(lut->mem); /* NULL for an embedded table */
+}
+
+
+/* Store a slot in the first free place from its home bucket onwards */
+
+static void insert(struct lut *lut, unsigned int timecode, slot_no_t position)
+{
+    unsigned int b, n;
+    struct slot *slot;
+
+    b = HOME(lut, timecode);
+
+    /* The fill factor guarantees a free slot; buckets are filled in
+     * order, so the first free slot ends the probe */
+
+    for (;;) {
+        slot = lut->bucket[b].slot;
+
+        for (n = 0; n < LUT_BUCKET_SLOTS; n++) {
+            if (slot[n].position == NO_SLOT) {
+                slot[n].timecode = timecode;
+                slot[n].position = position;
+                return;
+            }
+        }
+
+        if (++b == lut->nbuckets)
+            b = 0;
+    }
 }
 
 
 void lut_push(struct lut *lut, unsigned int timecode)
 {
-    unsigned int hash;
-    slot_no_t slot_no;
+    assert(lut->mem != NULL); /* mapped tables are read-only */
+
+    insert(lut, timecode, lut->avail++); /* take the next position */
+}
+
+
+/* Push the slots of one range of home buckets, without probing past
+ * the range so that ranges can be filled concurrently. Slots which
+ * would overflow are left for the caller. */
+
+static void push_range(struct lut *lut, const unsigned int *timecode,
+                       unsigned int n, unsigned int first, unsigned int end,
+                       std::vector<slot_no_t> *overflow)
+{
+    unsigned int i, b, s;
     struct slot *slot;
 
-    slot_no = lut->avail++; /* take the next available slot */
+    for (i = 0; i < n; i++) {
+        b = HOME(lut, timecode[i]);
+        if (b < first || b >= end)
+            continue;
+
+        for (; b < end; b++) {
+            slot = lut->bucket[b].slot;
 
-    slot = &lut->slot[slot_no];
-    slot->timecode = timecode;
+            for (s = 0; s < LUT_BUCKET_SLOTS; s++) {
+                if (slot[s].position == NO_SLOT) {
+                    slot[s].timecode = timecode[i];
+                    slot[s].position = i;
+                    break;
+                }
+            }
 
-    hash = HASH(timecode);
-    slot->next = lut->table[hash];
-    lut->table[hash] = slot_no;
+            if (s < LUT_BUCKET_SLOTS)
+                break;
+        }
+
+        if (b == end)
+            overflow->push_back(i);
+    }
+}
+
+
+/* Push n timecodes at once into an empty table, as if by lut_push() in
+ * order, with the buckets split into ranges over the given number of
+ * threads */
+
+void lut_push_all(struct lut *lut, const unsigned int *timecode,
+                  unsigned int n, int nthreads)
+{
+    std::vector<std::thread> thread;
+    std::vector< std::vector<slot_no_t> > overflow(nthreads);
+    unsigned int first, end;
+    size_t i;
+    int t;
+
+    assert(lut->mem != NULL && lut->avail == 0);
+
+    for (t = 0; t < nthreads; t++) {
+        first = (unsigned long long)lut->nbuckets * t / nthreads;
+        end = (unsigned long long)lut->nbuckets * (t + 1) / nthreads;
+        thread.push_back(std::thread(push_range, lut, timecode, n,
+                                     first, end, &overflow[t]));
+    }
+
+    for (t = 0; t < nthreads; t++)
+        thread[t].join();
+
+    /* The few slots which ran off the end of a range probe on into the
+     * next; the buckets they pass are full, so lookups still find them */
+
+    for (t = 0; t < nthreads; t++) {
+        for (i = 0; i < overflow[t].size(); i++)
+            insert(lut, timecode[overflow[t][i]], overflow[t][i]);
+    }
+
+    lut->avail = n;
 }
 
 
 unsigned int lut_lookup(struct lut *lut, unsigned int timecode)
 {
-    unsigned int hash;
-    slot_no_t slot_no;
-    struct slot *slot;
+    unsigned int b, n;
+    const struct slot *slot;
+
+    b = HOME(lut, timecode);
 
-    hash = HASH(timecode);
-    slot_no = lut->table[hash];
+    for (;;) {
+        slot = lut->bucket[b].slot;
 
-    while (slot_no != NO_SLOT) {
-        slot = &lut->slot[slot_no];
-        if (slot->timecode == timecode)
-            return slot_no;
-        slot_no = slot->next;
+        for (n = 0; n < LUT_BUCKET_SLOTS; n++) {
+            if (slot[n].position == NO_SLOT)
+                return (unsigned)-1;
+            if (slot[n].timecode == timecode)
+                return slot[n].position;
+        }
+
+        if (++b == lut->nbuckets)
+            b = 0;
     }
+}
+
+
+/* Checksum of the bucket array, so that a truncated or damaged file
+ * is never used */
+
+static unsigned int checksum(const struct bucket *bucket, unsigned int nbuckets)
+{
+    const unsigned int *w, *end;
+    unsigned int h;
+
+    w = (const unsigned int*)bucket;
+    end = w + (size_t)nbuckets * sizeof(struct bucket) / sizeof(*w);
+    h = 2166136261u;
+
+    while (w < end)
+        h = (h ^ *w++) * 16777619u;
+
+    return h;
+}
+
+
+/* Map a whole file read-only
+ *
+ * Return: base address of the mapping, or NULL on error */
+
+static void* map_file(const char *path, size_t *size)
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+    LARGE_INTEGER len;
+    void *base;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(file, &len) || len.QuadPart == 0
+        || (unsigned long long)len.QuadPart > (size_t)-1)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    /* The view keeps the mapping alive */
+
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    *size = (size_t)len.QuadPart;
+    return base;
+#else
+    struct stat st;
+    void *base;
+    int fd;
 
-    return (unsigned)-1;
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    *size = st.st_size;
+    return base;
+#endif
+}
+
+
+/* Point the lookup table at a file image in memory
+ *
+ * Return: -1 if the image is damaged or was not built from the given
+ * key, otherwise 0 */
+
+static int attach(struct lut *lut, const unsigned char *base, size_t size,
+                  const void *key, size_t key_len, bool verify)
+{
+    const struct lut_file *hdr;
+    size_t offset;
+
+    hdr = (const struct lut_file*)base;
+    offset = BUCKETS_OFFSET(key_len);
+
+    if (size < offset
+        || memcmp(hdr->magic, LUT_FILE_MAGIC, sizeof hdr->magic)
+        || hdr->version != LUT_FILE_VERSION
+        || hdr->endian != LUT_FILE_ENDIAN
+        || hdr->bucket_slots != LUT_BUCKET_SLOTS
+        || hdr->key_len != key_len
+        || memcmp(base + sizeof *hdr, key, key_len)
+        || hdr->nbuckets == 0
+        || size != offset + (size_t)hdr->nbuckets * sizeof(struct bucket)
+        || hdr->avail > hdr->nbuckets * LUT_BUCKET_SLOTS)
+    {
+        return -1;
+    }
+
+    if (verify && hdr->checksum != checksum((const struct bucket*)(base + offset),
+                                            hdr->nbuckets))
+    {
+        return -1;
+    }
+
+    lut->bucket = (struct bucket*)(base + offset);
+    lut->mem = NULL;
+    lut->map = NULL;
+    lut->nbuckets = hdr->nbuckets;
+    lut->avail = hdr->avail;
+
+    return 0;
+}
+
+
+/* Use a lookup table previously written by lut_save(), in place in
+ * the page cache
+ *
+ * Return: -1 if the file is missing, damaged or was not built from
+ * the given key, otherwise 0 */
+
+int lut_load(struct lut *lut, const char *path,
+             const void *key, size_t key_len)
+{
+    unsigned char *base;
+    size_t size;
+
+    base = (unsigned char*)map_file(path, &size);
+    if (base == NULL)
+        return -1;
+
+    if (attach(lut, base, size, key, key_len, true) == -1) {
+        fprintf(stderr, "Ignoring stale or damaged lookup table %s\n", path);
+        unmap(base, size);
+        return -1;
+    }
+
+    lut->map = base;
+    lut->map_size = size;
+
+    return 0;
+}
+
+
+/* Use a lookup table file image linked into the module, see
+ * lut_resource()
+ *
+ * The image is trusted to be intact, so that its pages are only read
+ * from the module on demand.
+ *
+ * Return: -1 if the image was not built from the given key, otherwise 0 */
+
+int lut_attach(struct lut *lut, const void *image, size_t size,
+               const void *key, size_t key_len)
+{
+    return attach(lut, (const unsigned char*)image, size, key, key_len, false);
+}
+
+
+/* Find the file image of a lookup table embedded in the module under
+ * the given name by the build (see tools/lutgen)
+ *
+ * Return: the image, or NULL if there is none */
+
+const void* lut_resource(const char *name, size_t *size)
+{
+#if defined(XWAX_EMBEDDED_LUT) && defined(_WIN32)
+    HMODULE module;
+    HRSRC res;
+    HGLOBAL data;
+
+    if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS
+                            | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                            (LPCSTR)&lut_resource, &module))
+    {
+        return NULL;
+    }
+
+    res = FindResourceA(module, name, MAKEINTRESOURCEA(10) /* RT_RCDATA */);
+    if (res == NULL)
+        return NULL;
+
+    data = LoadResource(module, res);
+    if (data == NULL)
+        return NULL;
+
+    *size = SizeofResource(module, res);
+    return LockResource(data);
+#else
+    (void)name;
+    (void)size;
+    return NULL;
+#endif
+}
+
+
+/* Write the lookup table to a file for lut_load()
+ *
+ * The file is written aside and renamed into place, so a concurrent
+ * reader never sees it partially written.
+ *
+ * Return: -1 if the file could not be written, otherwise 0 */
+
+int lut_save(struct lut *lut, const char *path,
+             const void *key, size_t key_len)
+{
+    static const char pad[CACHE_LINE] = { 0 };
+    struct lut_file hdr;
+    char tmp[FILENAME_MAX];
+    size_t offset, bytes;
+    FILE *f;
+    int r;
+
+    if (snprintf(tmp, sizeof tmp, "%s.%d", path, (int)getpid()) >= (int)sizeof tmp)
+        return -1;
+
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, LUT_FILE_MAGIC, sizeof hdr.magic);
+    hdr.version = LUT_FILE_VERSION;
+    hdr.endian = LUT_FILE_ENDIAN;
+    hdr.bucket_slots = LUT_BUCKET_SLOTS;
+    hdr.key_len = (unsigned int)key_len;
+    hdr.nbuckets = lut->nbuckets;
+    hdr.avail = lut->avail;
+    hdr.checksum = checksum(lut->bucket, lut->nbuckets);
+
+    offset = BUCKETS_OFFSET(key_len);
+    bytes = sizeof(struct bucket) * lut->nbuckets;
+
+    f = fopen(tmp, "wb");
+    if (f == NULL)
+        return -1;
+
+    r = fwrite(&hdr, sizeof hdr, 1, f) == 1
+        && fwrite(key, 1, key_len, f) == key_len
+        && fwrite(pad, 1, offset - sizeof hdr - key_len, f) == offset - sizeof hdr - key_len
+        && fwrite(lut->bucket, 1, bytes, f) == bytes;
+
+    if (fclose(f) != 0 || !r) {
+        remove(tmp);
+        return -1;
+    }
+
+#ifdef _WIN32
+    r = MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    r = rename(tmp, path);
+#endif
+    if (r != 0) {
+        remove(tmp);
+        return -1;
+    }
+
+    return 0;
 }
@@ -20,23 +20,52 @@
 #ifndef LUT_H
 #define LUT_H
 
+#include <stddef.h>
+
 typedef unsigned int slot_no_t;
 
+// MODS open addressing: the chained hash (one dependent cache miss per
+// link) is replaced by buckets of slots filling exactly one cache line,
+// probed linearly. A lookup costs one cache line, rarely two.
+
+#define LUT_BUCKET_SLOTS 8
+
 struct slot {
     unsigned int timecode;
-    slot_no_t next; /* next slot with the same hash */
+    slot_no_t position; /* order in which the timecode was pushed */
+};
+
+struct bucket {
+    struct slot slot[LUT_BUCKET_SLOTS];
 };
 
 struct lut {
-    struct slot *slot;
-    slot_no_t *table, /* hash -> slot lookup */
-        avail; /* next available slot */
+    struct bucket *bucket; /* cache line aligned */
+    void *mem; /* allocation backing the buckets, */
+    void *map; /* or file mapping, or neither when linked in the module */
+    size_t map_size;
+    unsigned int nbuckets;
+    slot_no_t avail; /* next available slot */
 };
 
 int lut_init(struct lut *lut, int nslots);
 void lut_clear(struct lut *lut);
 
 void lut_push(struct lut *lut, unsigned int timecode);
+void lut_push_all(struct lut *lut, const unsigned int *timecode,
+                  unsigned int n, int nthreads);
 unsigned int lut_lookup(struct lut *lut, unsigned int timecode);
 
+// MODS lookup tables can be saved to a file once, then mapped read-only
+// by later processes. The key identifies what the table was built from.
+int lut_load(struct lut *lut, const char *path,
+             const void *key, size_t key_len);
+int lut_save(struct lut *lut, const char *path,
+             const void *key, size_t key_len);
+
+// MODS or generated at build time and linked into the module
+const void* lut_resource(const char *name, size_t *size);
+int lut_attach(struct lut *lut, const void *image, size_t size,
+               const void *key, size_t key_len);
+
 #endif
@@ -25,19 +25,55 @@
 #define ALPHA (1.0/512)
 #define BETA (ALPHA/256)
 
+/* MODS runs of zero observations are applied as powers of the filter
+ * matrix, 2^0 to 2^(IDLE_POWERS - 1) observations each */
+
+#define IDLE_POWERS 16
+
 /* State of the pitch calculation filter */
 
 struct pitch {
     double dt, x, v;
+    double idle[IDLE_POWERS][2][2]; /* MODS filter matrix of 2^k zero observations */
 };
 
 /* Prepare the filter for observations every dt seconds */
 
 static inline void pitch_init(struct pitch *p, double dt)
 {
+    int k;
+
     p->dt = dt;
     p->x = 0.0;
     p->v = 0.0;
+
+    /* MODS one observation of dx = 0, see pitch_dt_observation() */
+
+    p->idle[0][0][0] = 1.0 - ALPHA;
+    p->idle[0][0][1] = (1.0 - ALPHA) * dt;
+    p->idle[0][1][0] = -BETA / dt;
+    p->idle[0][1][1] = 1.0 - BETA;
+
+    for (k = 1; k < IDLE_POWERS; k++) {
+        double (*m)[2] = p->idle[k - 1];
+
+        p->idle[k][0][0] = m[0][0] * m[0][0] + m[0][1] * m[1][0];
+        p->idle[k][0][1] = m[0][0] * m[0][1] + m[0][1] * m[1][1];
+        p->idle[k][1][0] = m[1][0] * m[0][0] + m[1][1] * m[1][0];
+        p->idle[k][1][1] = m[1][0] * m[0][1] + m[1][1] * m[1][1];
+    }
+}
+
+/* MODS Observe every dt seconds from now on, keeping the position and
+ * velocity estimated so far */
+
+static inline void pitch_set_dt(struct pitch *p, double dt)
+{
+    double x = p->x, v = p->v;
+
+    pitch_init(p, dt);
+    p->x = x;
+    p->v = v;
 }
 
 /* Input an observation to the filter; in the last dt seconds the
@@ -61,6 +97,32 @@ static inline void pitch_dt_observation(struct pitch *p, double dx)
     p->x -= dx; /* relative to previous */
 }
 
+/* MODS Apply 2^k observations of dx = 0 */
+
+static inline void pitch_idle_power(struct pitch *p, int k)
+{
+    double (*m)[2] = p->idle[k], x = p->x;
+
+    p->x = m[0][0] * x + m[0][1] * p->v;
+    p->v = m[1][0] * x + m[1][1] * p->v;
+}
+
+/* MODS Input n observations of dx = 0 at once; equal to as many calls
+ * to pitch_dt_observation() but for rounding */
+
+static inline void pitch_idle_observations(struct pitch *p, unsigned long n)
+{
+    int k;
+
+    for (; n >> (IDLE_POWERS - 1); n -= 1ul << (IDLE_POWERS - 1))
+        pitch_idle_power(p, IDLE_POWERS - 1);
+
+    for (k = 0; n != 0; k++, n >>= 1) {
+        if (n & 1)
+            pitch_idle_power(p, k);
+    }
+}
+
 /* Get the pitch after filtering */
 
 static inline double pitch_current(struct pitch *p)
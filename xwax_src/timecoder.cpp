@@ -19,10 +19,22 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 // MODS #include <unistd.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define X86
+#include <immintrin.h>
+#endif
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "debug.h"
 #include "timecoder.h"
@@ -39,8 +51,31 @@
 
 #define VALID_BITS 24
 
+/* MODS With TIMECODER_LOCK_ADJACENT, the number of lookups in a row
+ * giving successive positions in the direction of play before the
+ * position is reported. Each one follows a correct bit, but lookups
+ * also reject bitstreams which are not on the record at all */
+
+#define LOCK_LOOKUPS 12
+
+/* MODS A tolerant decoder takes at most this many bits in VALID_BITS
+ * as read wrongly before it lets the bitstream go, as after a needle
+ * drop */
+
+#define TOLERATE_BITS 2
+
 #define MONITOR_DECAY_EVERY 512 /* in samples */
 
+#define SCAN_BLOCK 256 /* in samples, scanned for crossings at once */
+
+// MODS functions using instructions beyond the baseline, only called
+// once the processor is known to have them
+#if defined(__GNUC__)
+#define TARGET(isa) __attribute__((target(isa)))
+#else
+#define TARGET(isa)
+#endif
+
 #define SQ(x) ((x)*(x))
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
 
@@ -132,30 +167,73 @@ static struct timecode_def timecodes[] = {
 	},
 };
 
+// MODS the definitions are shared by all decoders, whatever their
+// thread: building, counting users and freeing the lookup tables, and
+// the settings below, go through this lock
+static std::mutex registry;
+
+// MODS directory of the lookup table cache, empty for no cache
+static char lut_cache_dir[FILENAME_MAX];
+
+// MODS threads building a lookup table, 0 for one per core
+static int lut_build_threads;
+
+// MODS the same definitions with sparse lookup tables, see lookup();
+// filled on first use. Decoders of a timecode hold either kind of table
+// without disturbing the others
+static struct timecode_def sparse_timecodes[ARRAY_SIZE(timecodes)];
+
+// MODS kernel asked for by timecoder_set_kernel(); read on every
+// submit, so atomic rather than under the lock
+static std::atomic<int> kernel_choice(TIMECODER_KERNEL_AUTO);
+
+// MODS decode every block with the reference kernel too, see verify()
+static std::atomic<bool> kernel_verify(false);
+static std::atomic<unsigned long> verify_failures(0);
+
+// MODS decode every definition with the generic kernels, for comparison
+static std::atomic<bool> kernel_generic(false);
+
 /*
  * Calculate LFSR bit
  */
 
+// MODS parity with the processor's population count where there is one
 static inline bits_t lfsr(bits_t code, bits_t taps)
 {
     bits_t taken;
-    int xrs;
 
     taken = code & taps;
-    xrs = 0;
-    while (taken != 0x0) {
-        xrs += taken & 0x1;
-        taken >>= 1;
-    }
 
-    return xrs & 0x1;
+#if defined(__GNUC__)
+    return __builtin_parity(taken);
+#elif defined(_MSC_VER) && defined(__AVX__)
+    return __popcnt(taken) & 0x1;
+#else
+    taken ^= taken >> 16;
+    taken ^= taken >> 8;
+    taken ^= taken >> 4;
+    taken ^= taken >> 2;
+    taken ^= taken >> 1;
+    return taken & 0x1;
+#endif
 }
 
+// MODS the decoder kernels below are specialised at compile time for
+// the flags and bit width of a definition; ANY_FLAGS and a width of 0
+// read them from the definition instead
+
+#define ANY_FLAGS (~0u)
+
+#define DEF_FLAGS(def) (Flags == ANY_FLAGS ? (unsigned int)(def)->flags : Flags)
+#define DEF_BITS(def) (Bits == 0 ? (def)->bits : Bits)
+
 /*
  * Linear Feedback Shift Register in the forward direction. New values
  * are generated at the least-significant bit.
  */
 
+template <int Bits = 0>
 static inline bits_t fwd(bits_t current, struct timecode_def *def)
 {
     bits_t l;
@@ -163,43 +241,126 @@ static inline bits_t fwd(bits_t current, struct timecode_def *def)
     /* New bits are added at the MSB; shift right by one */
 
     l = lfsr(current, def->taps | 0x1);
-    return (current >> 1) | (l << (def->bits - 1));
+    return (current >> 1) | (l << (DEF_BITS(def) - 1));
 }
 
 /*
  * Linear Feedback Shift Register in the reverse direction
  */
 
+template <int Bits = 0>
 static inline bits_t rev(bits_t current, struct timecode_def *def)
 {
     bits_t l, mask;
 
     /* New bits are added at the LSB; shift left one and mask */
 
-    mask = (1 << def->bits) - 1;
-    l = lfsr(current, (def->taps >> 1) | (0x1 << (def->bits - 1)));
+    mask = (1 << DEF_BITS(def)) - 1;
+    l = lfsr(current, (def->taps >> 1) | (0x1 << (DEF_BITS(def) - 1)));
     return ((current << 1) & mask) | l;
 }
 
 /*
- * Where necessary, build the lookup table required for this timecode
- *
- * Return: -1 if not enough memory could be allocated, otherwise 0
+ * The LFSR is linear over GF(2), so stepping n times is applying the
+ * n-th power of its transition matrix. A matrix is held as the images
+ * of each single bit.
  */
 
-static int build_lookup(struct timecode_def *def)
+struct lfsr_matrix {
+    bits_t col[sizeof(bits_t) * CHAR_BIT];
+};
+
+static bits_t matrix_apply(const struct lfsr_matrix *m, bits_t x)
+{
+    bits_t r;
+    int n;
+
+    r = 0;
+    for (n = 0; x != 0; n++, x >>= 1) {
+        if (x & 0x1)
+            r ^= m->col[n];
+    }
+
+    return r;
+}
+
+/*
+ * Transition matrix of n steps of the LFSR in the forward direction
+ */
+
+static void matrix_fwd(struct lfsr_matrix *m, struct timecode_def *def,
+                       unsigned int n)
+{
+    struct lfsr_matrix step, next;
+    int i;
+
+    for (i = 0; i < def->bits; i++) {
+        step.col[i] = fwd((bits_t)1 << i, def);
+        m->col[i] = (bits_t)1 << i;
+    }
+
+    /* Multiply in step^(2^k) for each bit k set in n */
+
+    while (n != 0) {
+        if (n & 0x1) {
+            for (i = 0; i < def->bits; i++)
+                next.col[i] = matrix_apply(&step, m->col[i]);
+            *m = next;
+        }
+
+        for (i = 0; i < def->bits; i++)
+            next.col[i] = matrix_apply(&step, step.col[i]);
+        step = next;
+
+        n >>= 1;
+    }
+}
+
+/*
+ * Jump ahead n steps of the LFSR in the forward direction
+ */
+
+static bits_t fwd_n(bits_t current, struct timecode_def *def, unsigned int n)
+{
+    struct lfsr_matrix m;
+
+    matrix_fwd(&m, def, n);
+    return matrix_apply(&m, current);
+}
+
+/*
+ * Generate the timecodes of positions first to end - 1 into code[]
+ */
+
+static void build_segment(struct timecode_def *def, bits_t *code,
+                          unsigned int first, unsigned int end)
 {
     unsigned int n;
     bits_t current;
 
-    if (def->lookup)
-        return 0;
+    current = fwd_n(def->seed, def, first);
 
-    fprintf(stderr, "Building LUT for %d bit %dHz timecode (%s)\n",
-            def->bits, def->resolution, def->desc);
+    for (n = first; n < end; n++) {
+        bits_t next;
 
-    if (lut_init(&def->lut, def->length) == -1)
-	return -1;
+        code[n] = current;
+
+        /* check symmetry of the lfsr functions */
+        next = fwd(current, def);
+        dassert(rev(next, def) == current);
+
+        current = next;
+    }
+}
+
+/*
+ * Fill the lookup table one position after the other
+ */
+
+static void build_serial(struct timecode_def *def)
+{
+    unsigned int n;
+    bits_t current;
 
     current = def->seed;
 
@@ -216,19 +377,307 @@ static int build_lookup(struct timecode_def *def)
 
         current = next;
     }
+}
+
+/*
+ * Fill the lookup table with every stride-th position only; see
+ * lookup() for the positions in between
+ */
+
+static void build_sparse(struct timecode_def *def)
+{
+    struct lfsr_matrix jump;
+    unsigned int n;
+    bits_t current;
+
+    matrix_fwd(&jump, def, def->stride);
+    current = def->seed;
+
+    for (n = 0; n < def->length; n += def->stride) {
+        lut_push(&def->lut, current);
+        current = matrix_apply(&jump, current);
+    }
+}
+
+/*
+ * Fill the lookup table using several threads: the sequence is split
+ * into segments generated concurrently from their jump-ahead start,
+ * then pushed concurrently
+ *
+ * Return: -1 if not enough memory could be allocated, otherwise 0
+ */
+
+static int build_parallel(struct timecode_def *def, int nthreads)
+{
+    std::vector<std::thread> thread;
+    unsigned int first, end;
+    bits_t *code;
+    int t;
+
+    code = (bits_t*)malloc(sizeof(bits_t) * def->length);
+    if (code == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (t = 0; t < nthreads; t++) {
+        first = (unsigned long long)def->length * t / nthreads;
+        end = (unsigned long long)def->length * (t + 1) / nthreads;
+        thread.push_back(std::thread(build_segment, def, code, first, end));
+    }
+
+    for (t = 0; t < nthreads; t++)
+        thread[t].join();
+
+    lut_push_all(&def->lut, code, def->length, nthreads);
+
+#ifdef DEBUG
+    {
+        unsigned int n;
+
+        /* timecode must not wrap */
+        for (n = 0; n < def->length; n++)
+            dassert(lut_lookup(&def->lut, code[n]) == n);
+    }
+#endif
+
+    free(code);
+
+    return 0;
+}
+
+/*
+ * Where necessary, build the lookup table required for this timecode
+ *
+ * Return: -1 if not enough memory could be allocated, otherwise 0
+ */
+
+// MODS everything the table content depends on; a file built from a
+// different definition is never used
+struct lut_key {
+    char name[32];
+    bits_t seed, taps;
+    int bits;
+    unsigned int length;
+};
+
+// MODS Return: -1 if the path of the cached file does not fit, otherwise 0
+
+static int lut_cache_key(struct timecode_def *def, struct lut_key *key,
+                         char *path, size_t len)
+{
+    int r;
+
+    memset(key, 0, sizeof *key);
+    strncpy(key->name, def->name, sizeof key->name - 1);
+    key->seed = def->seed;
+    key->taps = def->taps;
+    key->bits = def->bits;
+    key->length = def->length;
+
+    r = snprintf(path, len, "%s/%s.lut", lut_cache_dir, def->name);
+    if (r < 0 || (size_t)r >= len)
+        return -1;
+
+    return 0;
+}
+
+static int build_lookup(struct timecode_def *def)
+{
+    int nthreads;
+    struct lut_key key;
+    char path[FILENAME_MAX];
+    const void *image;
+    size_t size;
+    bool cached;
+
+    if (def->lookup)
+        return 0;
+
+    // MODS a sparse table is small and quick to build, it is never cached
+    if (def->sparse) {
+        def->stride = (unsigned int)sqrt((double)def->length) + 1;
+
+        fprintf(stderr, "Building sparse LUT for %d bit %dHz timecode (%s)\n",
+                def->bits, def->resolution, def->desc);
+
+        if (lut_init(&def->lut, (def->length + def->stride - 1) / def->stride) == -1)
+            return -1;
+
+        build_sparse(def);
+        def->lookup = true;
+        return 0;
+    }
+
+    def->stride = 1;
+
+    // MODS a cache folder too long for the path is not used
+    cached = (lut_cache_key(def, &key, path, sizeof path) == 0
+              && lut_cache_dir[0] != '\0');
+
+    // MODS use the table generated at build time when there is one
+    image = lut_resource(def->name, &size);
+    if (image != NULL && lut_attach(&def->lut, image, size, &key, sizeof key) == 0) {
+        def->lookup = true;
+        return 0;
+    }
+
+    // MODS map the table from the cache when a valid one is there
+    if (cached) {
+        if (lut_load(&def->lut, path, &key, sizeof key) == 0) {
+            if (lut_lookup(&def->lut, def->seed) == 0
+                && def->lut.avail == def->length)
+            {
+                fprintf(stderr, "Mapped LUT for %s from %s\n", def->desc, path);
+                def->lookup = true;
+                return 0;
+            }
+            lut_clear(&def->lut);
+        }
+    }
+
+    fprintf(stderr, "Building LUT for %d bit %dHz timecode (%s)\n",
+            def->bits, def->resolution, def->desc);
+
+    if (lut_init(&def->lut, def->length) == -1)
+	return -1;
+
+    // MODS share the work when there are several cores
+    nthreads = lut_build_threads;
+    if (nthreads <= 0)
+        nthreads = std::thread::hardware_concurrency();
+
+    if (nthreads <= 1)
+        build_serial(def);
+    else if (build_parallel(def, nthreads) == -1) {
+        lut_clear(&def->lut);
+        return -1;
+    }
 
     def->lookup = true;
 
+    // MODS failing to write the cache only costs a rebuild next time
+    if (cached && lut_save(&def->lut, path, &key, sizeof key) == -1)
+    {
+        fprintf(stderr, "Could not write LUT cache %s\n", path);
+    }
+
     return 0;
 }
 
 /*
- * Find a timecode definition by name
+ * Set the number of threads building a lookup table, or 0 for one per
+ * core
+ */
+
+void timecoder_set_build_threads(int nthreads)
+{
+    std::lock_guard<std::mutex> lock(registry);
+
+    lut_build_threads = nthreads;
+}
+
+/*
+ * Set the directory where lookup tables are cached between runs, or
+ * NULL to always build them in memory
+ */
+
+void timecoder_set_cache_dir(const char *dir)
+{
+    size_t len;
+
+    std::lock_guard<std::mutex> lock(registry);
+
+    if (dir == NULL) {
+        lut_cache_dir[0] = '\0';
+        return;
+    }
+
+    strncpy(lut_cache_dir, dir, sizeof lut_cache_dir - 1);
+    lut_cache_dir[sizeof lut_cache_dir - 1] = '\0';
+
+    /* Paths are built as dir/name.lut */
+
+    len = strlen(lut_cache_dir);
+    while (len > 0 && (lut_cache_dir[len - 1] == '/' || lut_cache_dir[len - 1] == '\\'))
+        lut_cache_dir[--len] = '\0';
+}
+
+/*
+ * Position of a timecode on the record. A sparse table only holds
+ * every stride-th position, then the LFSR is stepped back to the
+ * previous one held.
+ *
+ * Return: position, or -1 if the timecode is not on the record
+ */
+
+static unsigned int lookup(struct timecode_def *def, bits_t timecode)
+{
+    unsigned int n, r;
+
+    if (def->stride <= 1)
+        return lut_lookup(&def->lut, timecode);
+
+    for (n = 0; n < def->stride; n++) {
+        r = lut_lookup(&def->lut, timecode);
+
+        if (r != (unsigned)-1) {
+            r = r * def->stride + n;
+            return r < def->length ? r : (unsigned)-1;
+        }
+
+        timecode = rev(timecode, def);
+    }
+
+    return (unsigned)-1;
+}
+
+/*
+ * Free the lookup table of a definition which has no users left
+ */
+
+static void drop_lookup(struct timecode_def *def)
+{
+    if (def->users == 0 && def->lookup) {
+        lut_clear(&def->lut);
+        def->lookup = false;
+    }
+}
+
+/*
+ * MODS The copy of a definition which has a sparse lookup table
+ */
+
+static struct timecode_def* sparse_definition(struct timecode_def *def)
+{
+    struct timecode_def *sparse;
+
+    sparse = &sparse_timecodes[def - timecodes];
+
+    if (!sparse->sparse) {
+        *sparse = *def;
+        memset(&sparse->lut, 0, sizeof sparse->lut);
+        sparse->lookup = false;
+        sparse->users = 0;
+        sparse->sparse = true;
+    }
+
+    return sparse;
+}
+
+/*
+ * Find a timecode definition by name, and hold its lookup table until
+ * timecoder_release_definition()
+ *
+ * MODS Full tables take megabytes; sparse tables take tens of kilobytes,
+ * but a lookup steps the LFSR up to the square root of the length. Each
+ * kind is held and freed on its own, so both can be in use at once.
  *
  * Return: pointer to timecode definition, or NULL if not found
  */
 
-struct timecode_def* timecoder_find_definition(const char *name)
+struct timecode_def* timecoder_find_definition(const char *name,
+                                               enum timecoder_lookup mode)
 {
     struct timecode_def *def, *end;
 
@@ -245,12 +694,47 @@ struct timecode_def* timecoder_find_definition(const char *name)
             return NULL;
     }
 
+    // MODS the first user builds the table, concurrent users wait for it
+    std::lock_guard<std::mutex> lock(registry);
+
+    if (mode == TIMECODER_LOOKUP_SPARSE)
+        def = sparse_definition(def);
+
     if (build_lookup(def) == -1)
         return NULL;
 
+    def->users++;
+
     return def;
 }
 
+/*
+ * Release a definition returned by timecoder_find_definition(); the
+ * lookup table is freed with its last user
+ */
+
+void timecoder_release_definition(struct timecode_def *def)
+{
+    std::lock_guard<std::mutex> lock(registry);
+
+    assert(def->users > 0);
+    def->users--;
+    drop_lookup(def);
+}
+
+/*
+ * MODS Position of a timecode on the record, from the lookup table of
+ * a definition held with timecoder_find_definition()
+ *
+ * Return: position, or -1 if the timecode is not on the record
+ */
+
+unsigned int timecoder_find_position(struct timecode_def *def, bits_t timecode)
+{
+    assert(def->lookup);
+    return lookup(def, timecode);
+}
+
 /*
  * Free the timecoder lookup tables when they are no longer needed
  */
@@ -258,12 +742,15 @@ struct timecode_def* timecoder_find_definition(const char *name)
 void timecoder_free_lookup(void) {
     struct timecode_def *def, *end;
 
+    std::lock_guard<std::mutex> lock(registry);
+
     def = &timecodes[0];
     end = def + ARRAY_SIZE(timecodes);
 
+    // MODS tables still held by a decoder are left to their last user
     while (def < end) {
-        if (def->lookup)
-            lut_clear(&def->lut);
+        drop_lookup(def);
+        drop_lookup(&sparse_timecodes[def - timecodes]);
         def++;
     }
 }
@@ -284,6 +771,21 @@ static void init_channel(struct timecoder_channel *ch)
  * Return: -1 if the timecoder could not be initialised, otherwise 0
  */
 
+/*
+ * MODS Set the values precomputed from the sample rate and preamp
+ */
+
+static void set_rate(struct timecoder *tc, unsigned int sample_rate,
+                     bool phono)
+{
+    tc->dt = 1.0 / sample_rate;
+    tc->zero_alpha = tc->dt / (ZERO_RC + tc->dt);
+    tc->zero_coeff = (unsigned int)(tc->zero_alpha * 4294967296.0 + 0.5);
+    tc->threshold = ZERO_THRESHOLD;
+    if (phono)
+        tc->threshold >>= 5; /* approx -36dB */
+}
+
 void timecoder_init(struct timecoder *tc, struct timecode_def *def,
                     double speed, unsigned int sample_rate, bool phono)
 {
@@ -292,15 +794,13 @@ void timecoder_init(struct timecoder *tc, struct timecode_def *def,
     /* A definition contains a lookup table which can be shared
      * across multiple timecoders */
 
+    // MODS held by the caller until timecoder_clear(), see
+    // timecoder_find_definition()
     assert(def->lookup);
     tc->def = def;
     tc->speed = speed;
 
-    tc->dt = 1.0 / sample_rate;
-    tc->zero_alpha = tc->dt / (ZERO_RC + tc->dt);
-    tc->threshold = ZERO_THRESHOLD;
-    if (phono)
-        tc->threshold >>= 5; /* approx -36dB */
+    set_rate(tc, sample_rate, phono);
 
     tc->forwards = 1;
     init_channel(&tc->primary);
@@ -312,8 +812,21 @@ void timecoder_init(struct timecoder *tc, struct timecode_def *def,
     tc->timecode = 0;
     tc->valid_counter = 0;
     tc->timecode_ticker = 0;
+    tc->position = -1;
+    tc->lock = TIMECODER_LOCK_BITS;
+    tc->candidate = -1;
+    tc->lookups = 0;
+    tc->tolerant = false;
+    tc->errors = 0;
 
     tc->mon = NULL;
+    tc->trace_position = NULL;
+    tc->trace_pitch = NULL;
+    tc->bits = NULL;
+    tc->bits_size = 0;
+    tc->nbits = 0;
+    tc->bits_dropped = 0;
+    tc->at = 0;
 }
 
 /*
@@ -326,10 +839,165 @@ void timecoder_clear(struct timecoder *tc)
 }
 
 /*
- * Initialise a raster display of the incoming audio
+ * MODS Change the speed, sample rate or preamp of a decoder in place
  *
- * The monitor (otherwise known as 'scope' in the interface) is an x-y
- * display of the post-calibrated incoming audio.
+ * Unlike timecoder_init(), the bitstream, position, reference level,
+ * zero levels and pitch are kept, so a locked decoder stays locked.
+ * Counts of samples are rescaled to the new rate. Does not allocate,
+ * so it can be called between two blocks of audio.
+ */
+
+void timecoder_reconfigure(struct timecoder *tc, double speed,
+                           unsigned int sample_rate, bool phono)
+{
+    double scale;
+
+    scale = tc->dt * sample_rate; /* new samples per old sample */
+
+    tc->speed = speed;
+    set_rate(tc, sample_rate, phono);
+    pitch_set_dt(&tc->pitch, tc->dt);
+
+    tc->primary.crossing_ticker = (unsigned int)(tc->primary.crossing_ticker * scale);
+    tc->secondary.crossing_ticker = (unsigned int)(tc->secondary.crossing_ticker * scale);
+    tc->timecode_ticker = (unsigned int)(tc->timecode_ticker * scale);
+}
+
+/*
+ * MODS Move a decoder to another definition of the same timecode,
+ * which has the other kind of lookup table
+ *
+ * The bitstream and position are the same in both, so a locked decoder
+ * stays locked. The caller holds the new definition as for
+ * timecoder_init(), and releases the old one.
+ */
+
+void timecoder_set_definition(struct timecoder *tc, struct timecode_def *def)
+{
+    assert(def->lookup);
+    assert(def->seed == tc->def->seed && def->taps == tc->def->taps);
+    assert(def->length == tc->def->length);
+
+    tc->def = def;
+}
+
+/*
+ * MODS Take note of what a decoder has learnt of its signal
+ */
+
+void timecoder_get_calibration(struct timecoder *tc,
+                               struct timecoder_calibration *c)
+{
+    c->ref_level = tc->ref_level;
+    c->zero[0] = tc->primary.zero;
+    c->zero[1] = tc->secondary.zero;
+    c->pitch = tc->pitch.v;
+    c->position = timecoder_get_position(tc, NULL);
+}
+
+/*
+ * MODS Start a decoder from a calibration taken from another, or
+ * saved by an earlier run, instead of from nothing
+ *
+ * With the reference level known, bits are read from the first peak.
+ * The bitstream is set to the timecode at the position, so if the
+ * needle is still there the bits match from the first one; if not,
+ * the first mismatch resets it as usual. Either way no position is
+ * reported before VALID_BITS have matched.
+ */
+
+void timecoder_set_calibration(struct timecoder *tc,
+                               const struct timecoder_calibration *c)
+{
+    if (c->ref_level > 0)
+        tc->ref_level = c->ref_level;
+
+    tc->primary.zero = c->zero[0];
+    tc->secondary.zero = c->zero[1];
+
+    if (isfinite(c->pitch)) /* not NaN or infinite, from a damaged patch */
+        tc->pitch.v = c->pitch;
+
+    if (c->position >= 0 && (unsigned int)c->position < tc->def->length) {
+        tc->bitstream = fwd_n(tc->def->seed, tc->def, c->position);
+        tc->timecode = tc->bitstream;
+        tc->lookups = 0;
+        tc->errors = 0;
+    }
+}
+
+/*
+ * MODS Choose when a decoder first reports a position
+ *
+ * TIMECODER_LOCK_ADJACENT reports it once LOCK_LOOKUPS lookups in a
+ * row were successive positions, fewer bits than VALID_BITS; it costs
+ * a lookup per bit until then, and occasionally reports a wrong
+ * position for a few bits after a needle drop. It also reports one
+ * once VALID_BITS have matched, as TIMECODER_LOCK_BITS does.
+ */
+
+void timecoder_set_lock(struct timecoder *tc, enum timecoder_lock lock)
+{
+    tc->lock = lock;
+}
+
+/*
+ * MODS Let a decoder correct bits read wrongly, from dust or clicks,
+ * instead of losing its position for VALID_BITS
+ *
+ * A bit which does not match is corrected when the position is known
+ * and TOLERATE_BITS allows it, and a change of direction keeps the
+ * position; a needle moved to elsewhere on the record is then noticed
+ * a few bits later than otherwise.
+ */
+
+void timecoder_set_tolerant(struct timecoder *tc, bool tolerant)
+{
+    tc->tolerant = tolerant;
+}
+
+/*
+ * MODS Have the blocks submitted from now on also give the position
+ * and pitch after each of their samples, as timecoder_get_position()
+ * and timecoder_get_pitch() would
+ *
+ * The position is in seconds, or -1 where not known or beyond the safe
+ * zone. The buffers hold as many samples as the blocks; NULL for both
+ * stops the trace.
+ */
+
+void timecoder_set_trace(struct timecoder *tc, float *position, float *pitch)
+{
+    assert((position == NULL) == (pitch == NULL));
+
+    tc->trace_position = position;
+    tc->trace_pitch = pitch;
+}
+
+/*
+ * MODS Have the blocks submitted from now on also write each bit read
+ * while the position is known to the given array, with the sample it
+ * was read at; timecoder_get_bits() gives how many after each block
+ *
+ * At most one bit is read per sample, so an array of as many entries
+ * as samples in a block holds every bit; bits beyond size are not
+ * written, but counted by timecoder_get_bits_dropped(). NULL stops it.
+ */
+
+void timecoder_set_bits(struct timecoder *tc, struct timecoder_bit *bits,
+                        size_t size)
+{
+    tc->bits = bits;
+    tc->bits_size = bits == NULL ? 0 : size;
+    tc->nbits = 0;
+    tc->bits_dropped = 0;
+}
+
+/*
+ * Initialise a raster display of the incoming audio
+ *
+ * The monitor (otherwise known as 'scope' in the interface) is an x-y
+ * display of the post-calibrated incoming audio.
  *
  * Return: -1 if not enough memory could be allocated, otherwise 0
  */
@@ -360,12 +1028,34 @@ void timecoder_monitor_clear(struct timecoder *tc)
     tc->mon = NULL;
 }
 
+/*
+ * MODS Move zero towards the sample value by the filter coefficient,
+ * in Q32 fixed point
+ *
+ * Truncates toward zero as the conversion of the double precision
+ * filter did.
+ */
+
+static inline signed int zero_filter(signed int zero, signed int v,
+                                     unsigned int coeff)
+{
+    signed int d;
+    long long s;
+
+    d = (signed int)((unsigned int)v - (unsigned int)zero);
+    s = (long long)zero * 4294967296LL + (long long)d * coeff;
+    if (s < 0)
+        s += 0xffffffffLL;
+
+    return (signed int)(s >> 32);
+}
+
 /*
  * Update channel information with axis-crossings
  */
 
 static void detect_zero_crossing(struct timecoder_channel *ch,
-                                 signed int v, double alpha,
+                                 signed int v, unsigned int coeff,
                                  signed int threshold)
 {
     ch->crossing_ticker++;
@@ -381,7 +1071,144 @@ static void detect_zero_crossing(struct timecoder_channel *ch,
         ch->crossing_ticker = 0;
     }
 
-    ch->zero += alpha * (v - ch->zero);
+    // MODS was ch->zero += alpha * (v - ch->zero);
+    ch->zero = zero_filter(ch->zero, v, coeff);
+}
+
+/*
+ * MODS Count the samples before the next axis-crossing on either
+ * channel, filtering zero over them exactly as detect_zero_crossing()
+ */
+
+static size_t scan_crossings(struct timecoder *tc,
+                             const signed int (*s)[TIMECODER_CHANNELS],
+                             size_t ns)
+{
+    signed int zp, zs, threshold;
+    unsigned int coeff;
+    bool pp, ps;
+    size_t n;
+
+    zp = tc->primary.zero;
+    zs = tc->secondary.zero;
+    pp = tc->primary.positive;
+    ps = tc->secondary.positive;
+    threshold = tc->threshold;
+    coeff = tc->zero_coeff;
+
+    for (n = 0; n < ns; n++) {
+        signed int x = s[n][0], y = s[n][1];
+
+        if (pp ? x < zp - threshold : x > zp + threshold)
+            break;
+        if (ps ? y < zs - threshold : y > zs + threshold)
+            break;
+
+        zp = zero_filter(zp, x, coeff);
+        zs = zero_filter(zs, y, coeff);
+    }
+
+    tc->primary.zero = zp;
+    tc->secondary.zero = zs;
+
+    return n;
+}
+
+/*
+ * MODS Account for samples which crossed neither axis
+ */
+
+static void idle_samples(struct timecoder *tc, size_t n)
+{
+    tc->primary.crossing_ticker += n;
+    tc->secondary.crossing_ticker += n;
+    tc->primary.swapped = false;
+    tc->secondary.swapped = false;
+    tc->timecode_ticker += n;
+
+#ifdef DEBUG
+    {
+        struct pitch ref = tc->pitch;
+        size_t k;
+
+        /* the run in closed form matches the observations one by one */
+        for (k = 0; k < n; k++)
+            pitch_dt_observation(&ref, 0.0);
+        pitch_idle_observations(&tc->pitch, n);
+        dassert(fabs(tc->pitch.v - ref.v) <= 1e-9 * (fabs(ref.v) + 1e-3));
+        dassert(fabs(tc->pitch.x - ref.x) <= 1e-9 * (fabs(ref.x) + 1e-6));
+    }
+#else
+    pitch_idle_observations(&tc->pitch, n);
+#endif
+}
+
+/*
+ * MODS Whether the position of a decoder can be reported
+ */
+
+static inline bool locked(const struct timecoder *tc)
+{
+    return tc->valid_counter > VALID_BITS
+        || (tc->lock == TIMECODER_LOCK_ADJACENT && tc->lookups >= LOCK_LOOKUPS);
+}
+
+/*
+ * MODS Position of the last bit read in seconds, or -1 if it is not to
+ * be reported
+ */
+
+static double trace_origin(const struct timecoder *tc)
+{
+    if (tc->position == -1 || !locked(tc)
+        || (unsigned int)tc->position > tc->def->safe)
+    {
+        return -1.0;
+    }
+
+    return tc->position / (tc->def->resolution * tc->speed);
+}
+
+/*
+ * MODS Write the position and pitch after sample n of the block to the
+ * trace, once the sample is decoded
+ */
+
+static void trace_sample(struct timecoder *tc, size_t n)
+{
+    double origin, pitch;
+
+    origin = trace_origin(tc);
+    pitch = pitch_current(&tc->pitch) / tc->speed;
+
+    tc->trace_pitch[n] = (float)pitch;
+    tc->trace_position[n] = origin < 0.0 ? -1.0f
+        : (float)(origin + pitch * tc->timecode_ticker * tc->dt);
+}
+
+/*
+ * MODS Trace a run of n samples from sample at of the block which cross
+ * neither axis, before idle_samples() takes them at once; the filter
+ * is stepped sample by sample on a copy, as the reference kernel does
+ */
+
+static void trace_idle(struct timecoder *tc, size_t at, size_t n)
+{
+    struct pitch p;
+    double origin, pitch;
+    size_t k;
+
+    origin = trace_origin(tc);
+    p = tc->pitch;
+
+    for (k = 0; k < n; k++) {
+        pitch_dt_observation(&p, 0.0);
+        pitch = pitch_current(&p) / tc->speed;
+
+        tc->trace_pitch[at + k] = (float)pitch;
+        tc->trace_position[at + k] = origin < 0.0 ? -1.0f
+            : (float)(origin + pitch * (tc->timecode_ticker + k + 1) * tc->dt);
+    }
 }
 
 /*
@@ -425,6 +1252,48 @@ static void update_monitor(struct timecoder *tc, signed int x, signed int y)
  * Extract the bitstream from the sample value
  */
 
+/*
+ * MODS Look up a bitstream which matched its timecode, before a lock;
+ * the position is taken once LOCK_LOOKUPS in a row were adjacent in
+ * the direction of play
+ */
+
+static void confirm_lookup(struct timecoder *tc)
+{
+    signed int r;
+
+    r = lookup(tc->def, tc->bitstream);
+
+    if (r == -1)
+        tc->lookups = 0;
+    else if (tc->lookups > 0 && r == tc->candidate + (tc->forwards ? 1 : -1))
+        tc->lookups++;
+    else
+        tc->lookups = 1;
+
+    tc->candidate = r;
+
+    if (tc->lookups >= LOCK_LOOKUPS)
+        tc->position = r;
+}
+
+/*
+ * MODS Whether a bitstream which does not match its timecode is to be
+ * corrected rather than let go
+ *
+ * The bitstream matched the timecode before this bit, so the two
+ * differ in the bit just read only; the timecode is the next position
+ * on the record from the one known.
+ */
+
+static bool tolerate(const struct timecoder *tc)
+{
+    return tc->tolerant
+        && tc->position != -1
+        && tc->errors <= VALID_BITS * (TOLERATE_BITS - 1);
+}
+
+template <int Bits>
 static void process_bitstream(struct timecoder *tc, signed int m)
 {
     bits_t b;
@@ -438,23 +1307,66 @@ static void process_bitstream(struct timecoder *tc, signed int m)
      * the vinyl, regardless of the direction. */
 
     if (tc->forwards) {
-	tc->timecode = fwd(tc->timecode, tc->def);
+	tc->timecode = fwd<Bits>(tc->timecode, tc->def);
 	tc->bitstream = (tc->bitstream >> 1)
-	    + (b << (tc->def->bits - 1));
+	    + (b << (DEF_BITS(tc->def) - 1));
 
     } else {
 	bits_t mask;
 
-	mask = ((1 << tc->def->bits) - 1);
-	tc->timecode = rev(tc->timecode, tc->def);
+	mask = ((1 << DEF_BITS(tc->def)) - 1);
+	tc->timecode = rev<Bits>(tc->timecode, tc->def);
 	tc->bitstream = ((tc->bitstream << 1) & mask) + b;
     }
 
-    if (tc->timecode == tc->bitstream)
+    // MODS each bit corrected counts against the next VALID_BITS
+    if (tc->timecode != tc->bitstream && tolerate(tc)) {
+        tc->bitstream = tc->timecode;
+        tc->errors += VALID_BITS;
+    }
+
+    if (tc->timecode == tc->bitstream) {
 	tc->valid_counter++;
-    else {
+
+        if (tc->errors > 0)
+            tc->errors--;
+
+        // MODS a matching bit moves the bitstream one position along,
+        // which confirms it as a lookup would
+        if (tc->position != -1) {
+            tc->position += tc->forwards ? 1 : -1;
+            if ((unsigned int)tc->position >= tc->def->length) {
+                tc->position = -1;
+                tc->lookups = 0;
+            } else if (tc->lookups < LOCK_LOOKUPS) {
+                tc->lookups++;
+            }
+        } else if (tc->lock == TIMECODER_LOCK_ADJACENT) {
+            confirm_lookup(tc);
+        } else if (tc->valid_counter == VALID_BITS + 1) {
+            /* looked up as the lock is taken rather than by the next
+             * timecoder_get_position(), so a trace has it from here */
+            tc->position = lookup(tc->def, tc->bitstream);
+        }
+
+        // MODS give the caller the bit once the position is known
+        if (tc->bits_size != 0 && tc->position != -1 && locked(tc)) {
+            if (tc->nbits < tc->bits_size) {
+                struct timecoder_bit *e = &tc->bits[tc->nbits++];
+
+                e->offset = tc->at;
+                e->position = tc->position;
+                e->forwards = tc->forwards;
+            } else {
+                tc->bits_dropped++;
+            }
+        }
+    } else {
 	tc->timecode = tc->bitstream;
 	tc->valid_counter = 0;
+        tc->position = -1;
+        tc->lookups = 0;
+        tc->errors = 0;
     }
 
     /* Take note of the last time we read a valid timecode */
@@ -474,65 +1386,81 @@ static void process_bitstream(struct timecoder *tc, signed int m)
 }
 
 /*
- * Process a single sample from the incoming audio
- *
- * The two input signals (primary and secondary) are in the full range
- * of a signed int; ie. 32-bit signed.
+ * MODS Act on an axis-crossing of either channel, once zero, positive
+ * and swapped are up to date
  */
 
-static void process_sample(struct timecoder *tc,
-			   signed int primary, signed int secondary)
+template <unsigned int Flags, int Bits>
+static void process_crossing(struct timecoder *tc, signed int primary)
 {
-    detect_zero_crossing(&tc->primary, primary, tc->zero_alpha, tc->threshold);
-    detect_zero_crossing(&tc->secondary, secondary, tc->zero_alpha, tc->threshold);
+    bool forwards;
+    double dx;
 
     /* If an axis has been crossed, use the direction of the crossing
      * to work out the direction of the vinyl */
 
-    if (tc->primary.swapped || tc->secondary.swapped) {
-        bool forwards;
-
-        if (tc->primary.swapped) {
-            forwards = (tc->primary.positive != tc->secondary.positive);
-        } else {
-            forwards = (tc->primary.positive == tc->secondary.positive);
-        }
+    if (tc->primary.swapped) {
+        forwards = (tc->primary.positive != tc->secondary.positive);
+    } else {
+        forwards = (tc->primary.positive == tc->secondary.positive);
+    }
 
-        if (tc->def->flags & SWITCH_PHASE)
-	    forwards = !forwards;
+    if (DEF_FLAGS(tc->def) & SWITCH_PHASE)
+        forwards = !forwards;
 
-        if (forwards != tc->forwards) { /* direction has changed */
-            tc->forwards = forwards;
+    // MODS a tolerant decoder which knows its position follows it
+    // back, bits read wrongly after a false change count as errors
+    if (forwards != tc->forwards) { /* direction has changed */
+        tc->forwards = forwards;
+        if (!tolerate(tc)) {
             tc->valid_counter = 0;
+            tc->lookups = 0;
         }
     }
 
     /* If any axis has been crossed, register movement using the pitch
      * counters */
 
-    if (!tc->primary.swapped && !tc->secondary.swapped)
-	pitch_dt_observation(&tc->pitch, 0.0);
-    else {
-	double dx;
-
-	dx = 1.0 / tc->def->resolution / 4;
-	if (!tc->forwards)
-	    dx = -dx;
-	pitch_dt_observation(&tc->pitch, dx);
-    }
+    dx = 1.0 / tc->def->resolution / 4;
+    if (!tc->forwards)
+        dx = -dx;
+    pitch_dt_observation(&tc->pitch, dx);
 
     /* If we have crossed the primary channel in the right polarity,
      * it's time to read off a timecode 0 or 1 value */
 
     if (tc->secondary.swapped &&
-       tc->primary.positive == ((tc->def->flags & SWITCH_POLARITY) == 0))
+       tc->primary.positive == ((DEF_FLAGS(tc->def) & SWITCH_POLARITY) == 0))
     {
         signed int m;
 
         /* scale to avoid clipping */
         m = abs(primary / 2 - tc->primary.zero / 2);
-	process_bitstream(tc, m);
+	process_bitstream<Bits>(tc, m);
     }
+}
+
+/*
+ * Process a single sample from the incoming audio
+ *
+ * The two input signals (primary and secondary) are in the full range
+ * of a signed int; ie. 32-bit signed.
+ */
+
+template <unsigned int Flags, int Bits>
+static void process_sample(struct timecoder *tc,
+			   signed int primary, signed int secondary)
+{
+    detect_zero_crossing(&tc->primary, primary, tc->zero_coeff, tc->threshold);
+    detect_zero_crossing(&tc->secondary, secondary, tc->zero_coeff, tc->threshold);
+
+    // MODS crossings are handled by process_crossing(), shared with
+    // the decoder bank
+
+    if (tc->primary.swapped || tc->secondary.swapped)
+        process_crossing<Flags, Bits>(tc, primary);
+    else
+	pitch_dt_observation(&tc->pitch, 0.0);
 
     tc->timecode_ticker++;
 }
@@ -545,13 +1473,18 @@ static void process_sample(struct timecoder *tc,
 
 static struct timecode_def* next_definition(struct timecode_def *def)
 {
+    struct timecode_def *first;
+
     assert(def != NULL);
 
+    // MODS among the definitions with the same kind of table
+    first = def->sparse ? sparse_timecodes : timecodes;
+
     do {
         def++;
 
-        if (def > timecodes + ARRAY_SIZE(timecodes))
-            def = timecodes;
+        if (def >= first + ARRAY_SIZE(timecodes))
+            def = first;
 
     } while (!def->lookup);
 
@@ -564,26 +1497,80 @@ static struct timecode_def* next_definition(struct timecode_def *def)
 
 void timecoder_cycle_definition(struct timecoder *tc)
 {
-    tc->def = next_definition(tc->def);
+    struct timecode_def *def;
+
+    // MODS move the hold on the definition along with the decoder
+    {
+        std::lock_guard<std::mutex> lock(registry);
+
+        def = next_definition(tc->def);
+        def->users++;
+    }
+
+    timecoder_release_definition(tc->def);
+
+    tc->def = def;
     tc->valid_counter = 0;
     tc->timecode_ticker = 0;
+    tc->position = -1;
+    tc->lookups = 0;
+    tc->errors = 0;
 }
 
 /*
- * Submit and decode a block of PCM audio data to the timecode decoder
- *
- * PCM data is in the full range of signed short; ie. 16-bit signed.
+ * Input readers for the kernels, giving samples in the full range of
+ * a signed int
  */
 
-void timecoder_submit(struct timecoder *tc, signed short *pcm, size_t npcm)
+struct interleaved_s16 {
+    const signed short *pcm;
+
+    signed int left(size_t n) const { return pcm[n * TIMECODER_CHANNELS] << 16; }
+    signed int right(size_t n) const { return pcm[n * TIMECODER_CHANNELS + 1] << 16; }
+};
+
+struct planar_float {
+    const float *l, *r;
+
+    /* Full scale 1.0 is 2^31, clipped rather than wrapped; NaN is
+     * silence */
+
+    static signed int scale(float x)
+    {
+        x *= 2147483648.0f;
+
+        if (x >= 2147483648.0f)
+            return INT_MAX;
+        if (x <= -2147483648.0f)
+            return INT_MIN;
+        if (x != x)
+            return 0;
+
+        return (signed int)x;
+    }
+
+    signed int left(size_t n) const { return scale(l[n]); }
+    signed int right(size_t n) const { return scale(r[n]); }
+};
+
+/*
+ * MODS Decode a block of audio sample by sample, as xwax did; the
+ * reference for the other kernels, and the path of the monitor which
+ * plots every sample
+ */
+
+template <typename Input, unsigned int Flags, int Bits>
+static void sample_kernel(struct timecoder *tc, Input in, size_t npcm)
 {
-    while (npcm--) {
-	signed int left, right, primary, secondary;
+    size_t n;
 
-        left = pcm[0] << 16;
-        right = pcm[1] << 16;
+    for (n = 0; n < npcm; n++) {
+        signed int left, right, primary, secondary;
 
-        if (tc->def->flags & SWITCH_PRIMARY) {
+        left = in.left(n);
+        right = in.right(n);
+
+        if (DEF_FLAGS(tc->def) & SWITCH_PRIMARY) {
             primary = left;
             secondary = right;
         } else {
@@ -591,35 +1578,921 @@ void timecoder_submit(struct timecoder *tc, signed short *pcm, size_t npcm)
             secondary = left;
         }
 
-	process_sample(tc, primary, secondary);
+        tc->at = n;
+        process_sample<Flags, Bits>(tc, primary, secondary);
         update_monitor(tc, left, right);
 
-        pcm += TIMECODER_CHANNELS;
+        if (tc->trace_position)
+            trace_sample(tc, n);
     }
 }
 
 /*
- * Get the last-known position of the timecode
- *
- * If now data is available or if too few bits have been error
- * checked, then this counts as invalid. The last known position is
- * given along with the time elapsed since the position stamp was
- * read.
+ * Decode a block of audio with the kernel of the given flags and
+ * bit width
  *
- * Return: the known position of the timecode, or -1 if not known
- * Post: if when != NULL, *when is the elapsed time in seconds
+ * MODS Samples are scanned for axis-crossings a chunk at a time and
+ * only the crossings go through process_sample().
  */
 
-signed int timecoder_get_position(struct timecoder *tc, double *when)
+template <typename Input, unsigned int Flags, int Bits>
+static void submit_kernel(struct timecoder *tc, Input in, size_t npcm)
 {
-    signed int r;
+    signed int s[SCAN_BLOCK][TIMECODER_CHANNELS];
+    size_t n, base, ns;
 
-    if (tc->valid_counter <= VALID_BITS)
-        return -1;
+    if (tc->mon) {
+        sample_kernel<Input, Flags, Bits>(tc, in, npcm);
+        return;
+    }
 
-    r = lut_lookup(&tc->def->lut, tc->bitstream);
-    if (r == -1)
-        return -1;
+    for (base = 0; base < npcm; base += ns) {
+        ns = npcm - base;
+        if (ns > SCAN_BLOCK)
+            ns = SCAN_BLOCK;
+
+        for (n = 0; n < ns; n++) {
+            if (DEF_FLAGS(tc->def) & SWITCH_PRIMARY) {
+                s[n][0] = in.left(base + n);
+                s[n][1] = in.right(base + n);
+            } else {
+                s[n][0] = in.right(base + n);
+                s[n][1] = in.left(base + n);
+            }
+        }
+
+        n = 0;
+        for (;;) {
+            size_t idle;
+
+            idle = scan_crossings(tc, s + n, ns - n);
+            if (tc->trace_position)
+                trace_idle(tc, base + n, idle);
+            idle_samples(tc, idle);
+            n += idle;
+            if (n == ns)
+                break;
+
+            tc->at = base + n;
+            process_sample<Flags, Bits>(tc, s[n][0], s[n][1]);
+            if (tc->trace_position)
+                trace_sample(tc, base + n);
+            n++;
+        }
+    }
+}
+
+template <typename Input>
+using submit_kernel_t = void (*)(struct timecoder *tc, Input in, size_t npcm);
+
+/*
+ * The kernel for a definition: specialised for the combinations of
+ * flags and bit width of timecodes[], otherwise generic
+ */
+
+template <typename Input>
+static submit_kernel_t<Input> select_kernel(struct timecode_def *def)
+{
+    if (kernel_generic.load(std::memory_order_relaxed))
+        return submit_kernel<Input, ANY_FLAGS, 0>;
+
+    switch (def->flags) {
+    case 0:
+        if (def->bits == 20)
+            return submit_kernel<Input, 0, 20>;
+        break;
+    case SWITCH_PHASE:
+        if (def->bits == 20)
+            return submit_kernel<Input, SWITCH_PHASE, 20>;
+        break;
+    case SWITCH_PRIMARY | SWITCH_POLARITY | SWITCH_PHASE:
+        if (def->bits == 23)
+            return submit_kernel<Input, SWITCH_PRIMARY | SWITCH_POLARITY | SWITCH_PHASE, 23>;
+        break;
+    }
+
+    return submit_kernel<Input, ANY_FLAGS, 0>;
+}
+
+/*
+ * MODS The best kernel this processor and operating system can run
+ */
+
+static enum timecoder_kernel detect_kernel(void)
+{
+#if defined(X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return TIMECODER_KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return TIMECODER_KERNEL_AVX2;
+
+#elif defined(X86) && defined(_MSC_VER)
+    int r[4];
+    unsigned long long xcr0;
+
+    __cpuid(r, 0);
+    if (r[0] < 7)
+        return TIMECODER_KERNEL_SCALAR;
+
+    __cpuid(r, 1);
+    if (!(r[2] & (1 << 27))) /* OSXSAVE */
+        return TIMECODER_KERNEL_SCALAR;
+
+    /* The registers must also be saved by the operating system */
+
+    xcr0 = _xgetbv(0);
+    __cpuidex(r, 7, 0);
+
+    if ((xcr0 & 0xe6) == 0xe6 && (r[1] & (1 << 16))) /* AVX512F */
+        return TIMECODER_KERNEL_AVX512;
+    if ((xcr0 & 0x6) == 0x6 && (r[1] & (1 << 5))) /* AVX2 */
+        return TIMECODER_KERNEL_AVX2;
+#endif
+
+    return TIMECODER_KERNEL_SCALAR;
+}
+
+/*
+ * MODS Ask for a kernel; one the processor does not support falls
+ * back to the best it does
+ */
+
+void timecoder_set_kernel(enum timecoder_kernel kernel)
+{
+    kernel_choice.store(kernel, std::memory_order_relaxed);
+}
+
+/*
+ * MODS The kernel decoding from now on, the processor being probed on
+ * the first call
+ */
+
+enum timecoder_kernel timecoder_get_kernel(void)
+{
+    static const enum timecoder_kernel best = detect_kernel();
+    enum timecoder_kernel kernel;
+
+    kernel = (enum timecoder_kernel)kernel_choice.load(std::memory_order_relaxed);
+    if (kernel == TIMECODER_KERNEL_AUTO || kernel > best)
+        return best;
+
+    return kernel;
+}
+
+/*
+ * MODS Decode every block with the reference kernel as well, on a copy
+ * of the decoder, and count the blocks where the two disagree; see
+ * timecoder_get_verify_failures()
+ *
+ * This is a test mode: it more than doubles the cost of decoding. A
+ * bank holds its copies from timecoder_bank_init(), so only the banks
+ * set up while verifying are verified.
+ */
+
+void timecoder_set_verify(bool verify)
+{
+    kernel_verify.store(verify, std::memory_order_relaxed);
+}
+
+/*
+ * MODS Decode every definition with the generic kernels, which read
+ * the flags and bit width from the definition, instead of the ones
+ * specialised for timecodes[]; to measure what the specialisation
+ * gains
+ */
+
+void timecoder_set_generic(bool generic)
+{
+    kernel_generic.store(generic, std::memory_order_relaxed);
+}
+
+/*
+ * MODS The number of blocks where the kernel and the reference
+ * disagreed since the program started; verify() runs on the audio
+ * thread, so this is how it reports
+ */
+
+unsigned long timecoder_get_verify_failures(void)
+{
+    return verify_failures.load(std::memory_order_relaxed);
+}
+
+/*
+ * Compare a decoder with a copy of it which was given the same block
+ * by the reference kernel
+ *
+ * The bitstream and everything derived from it must be identical;
+ * swapped only lasts for the sample it was set on. The pitch filter
+ * takes runs without crossings in closed form, so it is allowed to
+ * differ by rounding.
+ */
+
+static void verify(const struct timecoder *tc, const struct timecoder *ref)
+{
+    bool same;
+
+    same = tc->bitstream == ref->bitstream
+        && tc->timecode == ref->timecode
+        && tc->valid_counter == ref->valid_counter
+        && tc->timecode_ticker == ref->timecode_ticker
+        && tc->position == ref->position
+        && tc->lookups == ref->lookups
+        && tc->errors == ref->errors
+        && (tc->lookups == 0 || tc->candidate == ref->candidate)
+        && tc->forwards == ref->forwards
+        && tc->ref_level == ref->ref_level
+        && tc->primary.zero == ref->primary.zero
+        && tc->primary.positive == ref->primary.positive
+        && tc->primary.crossing_ticker == ref->primary.crossing_ticker
+        && tc->secondary.zero == ref->secondary.zero
+        && tc->secondary.positive == ref->secondary.positive
+        && tc->secondary.crossing_ticker == ref->secondary.crossing_ticker
+        && fabs(tc->pitch.v - ref->pitch.v) <= 1e-9 * (fabs(ref->pitch.v) + 1e-3)
+        && fabs(tc->pitch.x - ref->pitch.x) <= 1e-9 * (fabs(ref->pitch.x) + 1e-6);
+
+    if (!same)
+        verify_failures.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Decode a block with the kernel in use, and with the reference kernel
+ * if verifying
+ */
+
+template <typename Input>
+static void submit(struct timecoder *tc, Input in, size_t npcm)
+{
+    enum timecoder_kernel kernel;
+    struct timecoder ref;
+
+    tc->nbits = 0;
+    tc->bits_dropped = 0;
+
+    kernel = timecoder_get_kernel();
+    if (kernel == TIMECODER_KERNEL_REFERENCE) {
+        sample_kernel<Input, ANY_FLAGS, 0>(tc, in, npcm);
+        return;
+    }
+
+    /* The monitor already takes the reference path */
+
+    if (!kernel_verify.load(std::memory_order_relaxed) || tc->mon) {
+        select_kernel<Input>(tc->def)(tc, in, npcm);
+        return;
+    }
+
+    ref = *tc;
+    ref.trace_position = ref.trace_pitch = NULL;
+    ref.bits_size = 0;
+    select_kernel<Input>(tc->def)(tc, in, npcm);
+    sample_kernel<Input, ANY_FLAGS, 0>(&ref, in, npcm);
+    verify(tc, &ref);
+}
+
+/*
+ * Submit and decode a block of PCM audio data to the timecode decoder
+ *
+ * PCM data is in the full range of signed short; ie. 16-bit signed.
+ */
+
+void timecoder_submit(struct timecoder *tc, signed short *pcm, size_t npcm)
+{
+    interleaved_s16 in = { pcm };
+
+    // MODS one dispatch per block, no definition tests per sample
+    submit(tc, in, npcm);
+}
+
+/*
+ * MODS Submit and decode a block of audio given as one buffer per
+ * channel, as hosts hand it over
+ *
+ * Samples are float with full scale at +/-1.0; beyond it they clip.
+ */
+
+void timecoder_submit_planar_float(struct timecoder *tc,
+                                   const float *left, const float *right,
+                                   size_t npcm)
+{
+    planar_float in = { left, right };
+
+    submit(tc, in, npcm);
+}
+
+/*
+ * MODS An axis-crossing on either channel of one deck of a bank
+ */
+
+struct timecoder_event {
+    unsigned int n; /* row of the scan */
+    signed int primary, zero; /* primary sample, and zero after it */
+    unsigned char swapped, positive; /* bit 0 primary, bit 1 secondary */
+};
+
+#define BANK_LANE_GROUP 8 /* lanes are padded to a multiple... */
+#define BANK_LANE_GROUP_AVX512 16 /* ...or to this for AVX-512 */
+#define BANK_IDLE_THRESHOLD (INT_MAX / 2) /* never crossed from silence */
+
+/*
+ * Prepare a bank of decoders for the given number of decks
+ *
+ * The decoder of each deck is then set up with timecoder_init() on
+ * timecoder_bank_deck(), and cleared by the caller before the bank.
+ *
+ * Return: -1 if not enough memory could be allocated, otherwise 0
+ */
+
+int timecoder_bank_init(struct timecoder_bank *b, unsigned int decks)
+{
+    unsigned int l, group;
+    bool verifying;
+
+    assert(decks > 0 && decks <= TIMECODER_BANK_DECKS);
+
+    b->decks = decks;
+    b->kernel = timecoder_get_kernel();
+
+    if (b->kernel == TIMECODER_KERNEL_AVX512)
+        group = BANK_LANE_GROUP_AVX512;
+    else
+        group = BANK_LANE_GROUP;
+
+    b->lanes = (decks * TIMECODER_CHANNELS + group - 1) / group * group;
+
+    b->deck = (struct timecoder*)calloc(decks, sizeof *b->deck);
+    b->sample = (signed int*)calloc(SCAN_BLOCK * b->lanes, sizeof *b->sample);
+    b->zero = (signed int*)calloc(b->lanes, sizeof *b->zero);
+    b->positive = (signed int*)calloc(b->lanes, sizeof *b->positive);
+    b->threshold = (signed int*)calloc(b->lanes, sizeof *b->threshold);
+    b->coeff = (unsigned int*)calloc(b->lanes, sizeof *b->coeff);
+    b->event = (struct timecoder_event*)malloc(sizeof *b->event * SCAN_BLOCK * decks);
+    b->events = (unsigned int*)calloc(decks, sizeof *b->events);
+
+    /* Copies for the reference kernel, never allocated on the audio
+     * thread */
+
+    verifying = kernel_verify.load(std::memory_order_relaxed);
+    b->ref = verifying ? (struct timecoder*)calloc(decks, sizeof *b->ref) : NULL;
+
+    if (!b->deck || !b->sample || !b->zero || !b->positive ||
+        !b->threshold || !b->coeff || !b->event || !b->events ||
+        (verifying && !b->ref))
+    {
+        perror("malloc");
+        timecoder_bank_clear(b);
+        return -1;
+    }
+
+    /* Lanes without a deck are fed silence, and never cross */
+
+    for (l = 0; l < b->lanes; l++)
+        b->threshold[l] = BANK_IDLE_THRESHOLD;
+
+    return 0;
+}
+
+/*
+ * Clear resources associated with a bank
+ */
+
+void timecoder_bank_clear(struct timecoder_bank *b)
+{
+    free(b->deck);
+    free(b->sample);
+    free(b->zero);
+    free(b->positive);
+    free(b->threshold);
+    free(b->coeff);
+    free(b->event);
+    free(b->events);
+    free(b->ref);
+
+    b->deck = b->ref = NULL;
+    b->sample = b->zero = b->positive = b->threshold = NULL;
+    b->coeff = b->events = NULL;
+    b->event = NULL;
+}
+
+/*
+ * Convert ns samples of each deck from the given offset into rows of
+ * lanes; decks without inputs get silence
+ */
+
+static void bank_load(struct timecoder_bank *b,
+                      const float *const *primary,
+                      const float *const *secondary,
+                      size_t base, size_t ns)
+{
+    unsigned int d;
+    size_t n;
+
+    for (d = 0; d < b->decks; d++) {
+        signed int *s = b->sample + d * TIMECODER_CHANNELS;
+
+        if (primary[d] == NULL) {
+            for (n = 0; n < ns; n++, s += b->lanes)
+                s[0] = s[1] = 0;
+            continue;
+        }
+
+        for (n = 0; n < ns; n++, s += b->lanes) {
+            s[0] = planar_float::scale(primary[d][base + n]);
+            s[1] = planar_float::scale(secondary[d][base + n]);
+        }
+    }
+}
+
+/*
+ * Note a crossing of deck d in row n of the scan, given the positive
+ * bits and primary zero after it
+ */
+
+static inline void bank_event(struct timecoder_bank *b, unsigned int d,
+                              size_t n, unsigned int swapped,
+                              unsigned int positive, signed int zero)
+{
+    struct timecoder_event *e;
+
+    e = b->event + d * SCAN_BLOCK + b->events[d]++;
+    e->n = n;
+    e->primary = b->sample[n * b->lanes + d * TIMECODER_CHANNELS];
+    e->zero = zero;
+    e->swapped = swapped;
+    e->positive = positive;
+}
+
+/*
+ * Detect the crossings and filter the zero of all lanes over ns rows
+ *
+ * Without vectors there is nothing to gain from lockstep, so the
+ * decks are scanned one after the other.
+ */
+
+static void bank_scan_scalar(struct timecoder_bank *b, size_t ns)
+{
+    unsigned int d;
+    size_t n;
+
+    for (d = 0; d < b->decks; d++) {
+        unsigned int l = d * TIMECODER_CHANNELS;
+        const signed int *v = b->sample + l;
+        signed int zp, zs, tp, ts, pp, ps;
+        unsigned int cp, cs;
+
+        zp = b->zero[l];
+        zs = b->zero[l + 1];
+        pp = b->positive[l];
+        ps = b->positive[l + 1];
+        tp = b->threshold[l];
+        ts = b->threshold[l + 1];
+        cp = b->coeff[l];
+        cs = b->coeff[l + 1];
+
+        for (n = 0; n < ns; n++, v += b->lanes) {
+            unsigned int swapped;
+
+            swapped = (pp ? v[0] < zp - tp : v[0] > zp + tp)
+                | (ps ? v[1] < zs - ts : v[1] > zs + ts) << 1;
+
+            zp = zero_filter(zp, v[0], cp);
+            zs = zero_filter(zs, v[1], cs);
+
+            if (swapped) {
+                pp ^= -(signed int)(swapped & 1);
+                ps ^= -(signed int)(swapped >> 1);
+                bank_event(b, d, n, swapped, (pp & 1) | (ps & 2), zp);
+            }
+        }
+
+        b->zero[l] = zp;
+        b->zero[l + 1] = zs;
+        b->positive[l] = pp;
+        b->positive[l + 1] = ps;
+    }
+}
+
+#ifdef X86
+
+/*
+ * zero_filter() of eight lanes; coeff is below 2^31 for sample rates
+ * above 1kHz so it multiplies as signed
+ */
+
+TARGET("avx2")
+static inline __m256i zero_filter8(__m256i zero, __m256i v, __m256i coeff)
+{
+    __m256i d, even, odd;
+
+    d = _mm256_sub_epi32(v, zero);
+
+    /* products of the even and odd lanes in 64-bit words */
+
+    even = _mm256_mul_epi32(d, coeff);
+    odd = _mm256_mul_epi32(_mm256_srli_epi64(d, 32), _mm256_srli_epi64(coeff, 32));
+
+    even = _mm256_add_epi64(even, _mm256_slli_epi64(zero, 32));
+    odd = _mm256_add_epi64(odd, _mm256_and_si256(zero,
+                _mm256_set1_epi64x((long long)0xffffffff00000000ULL)));
+
+    /* truncate toward zero */
+
+    even = _mm256_add_epi64(even, _mm256_srli_epi64(_mm256_shuffle_epi32(
+                _mm256_srai_epi32(even, 31), _MM_SHUFFLE(3, 3, 1, 1)), 32));
+    odd = _mm256_add_epi64(odd, _mm256_srli_epi64(_mm256_shuffle_epi32(
+                _mm256_srai_epi32(odd, 31), _MM_SHUFFLE(3, 3, 1, 1)), 32));
+
+    /* the top halves are the new zeros */
+
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+}
+
+/*
+ * Detect the crossings and filter the zero of all lanes over ns rows,
+ * eight lanes at a time
+ *
+ * Both lanes of a deck are in the same group, so the crossings of each
+ * deck are still noted in order.
+ */
+
+TARGET("avx2")
+static void bank_scan_avx2(struct timecoder_bank *b, size_t ns)
+{
+    unsigned int l;
+    size_t n;
+
+    for (l = 0; l < b->lanes; l += BANK_LANE_GROUP) {
+        __m256i zero, pos, thr, coeff;
+
+        zero = _mm256_loadu_si256((const __m256i*)(b->zero + l));
+        pos = _mm256_loadu_si256((const __m256i*)(b->positive + l));
+        thr = _mm256_loadu_si256((const __m256i*)(b->threshold + l));
+        coeff = _mm256_loadu_si256((const __m256i*)(b->coeff + l));
+
+        for (n = 0; n < ns; n++) {
+            __m256i v, up, down, swapped;
+            unsigned int crossed;
+
+            v = _mm256_loadu_si256((const __m256i*)(b->sample + n * b->lanes + l));
+            up = _mm256_andnot_si256(pos, _mm256_cmpgt_epi32(v, _mm256_add_epi32(zero, thr)));
+            down = _mm256_and_si256(pos, _mm256_cmpgt_epi32(_mm256_sub_epi32(zero, thr), v));
+            swapped = _mm256_or_si256(up, down);
+
+            pos = _mm256_xor_si256(pos, swapped);
+            zero = zero_filter8(zero, v, coeff);
+
+            crossed = _mm256_movemask_ps(_mm256_castsi256_ps(swapped));
+            if (crossed) {
+                unsigned int d, k;
+
+                _mm256_storeu_si256((__m256i*)(b->zero + l), zero);
+                _mm256_storeu_si256((__m256i*)(b->positive + l), pos);
+
+                for (k = l; crossed != 0; k += 2, crossed >>= 2) {
+                    if ((crossed & 3) == 0)
+                        continue;
+                    d = k / TIMECODER_CHANNELS;
+                    bank_event(b, d, n, crossed & 3,
+                               (b->positive[k] & 1) | (b->positive[k + 1] & 2),
+                               b->zero[k]);
+                }
+            }
+        }
+
+        _mm256_storeu_si256((__m256i*)(b->zero + l), zero);
+        _mm256_storeu_si256((__m256i*)(b->positive + l), pos);
+    }
+}
+
+/*
+ * zero_filter() of sixteen lanes
+ *
+ * The 64-bit multiplies and shifts are the zero-masked forms with
+ * every lane written: GCC builds the plain forms on an undefined
+ * vector, and warns that it may be used uninitialised.
+ */
+
+#define ALL_LANES64 ((__mmask8)0xff)
+
+TARGET("avx512f")
+static inline __m512i zero_filter16(__m512i zero, __m512i v, __m512i coeff)
+{
+    __m512i d, even, odd;
+
+    d = _mm512_sub_epi32(v, zero);
+
+    even = _mm512_maskz_mul_epi32(ALL_LANES64, d, coeff);
+    odd = _mm512_maskz_mul_epi32(ALL_LANES64,
+                                 _mm512_maskz_srli_epi64(ALL_LANES64, d, 32),
+                                 _mm512_maskz_srli_epi64(ALL_LANES64, coeff, 32));
+
+    even = _mm512_add_epi64(even, _mm512_maskz_slli_epi64(ALL_LANES64, zero, 32));
+    odd = _mm512_add_epi64(odd, _mm512_and_si512(zero,
+                _mm512_set1_epi64((long long)0xffffffff00000000ULL)));
+
+    /* truncate toward zero; AVX-512 has the 64-bit arithmetic shift */
+
+    even = _mm512_add_epi64(even, _mm512_maskz_srli_epi64(ALL_LANES64,
+                _mm512_maskz_srai_epi64(ALL_LANES64, even, 63), 32));
+    odd = _mm512_add_epi64(odd, _mm512_maskz_srli_epi64(ALL_LANES64,
+                _mm512_maskz_srai_epi64(ALL_LANES64, odd, 63), 32));
+
+    return _mm512_mask_blend_epi32(0xaaaa,
+                _mm512_maskz_srli_epi64(ALL_LANES64, even, 32), odd);
+}
+
+/*
+ * bank_scan_avx2() sixteen lanes at a time, with the positive lanes
+ * and the crossings held in mask registers
+ */
+
+TARGET("avx512f")
+static void bank_scan_avx512(struct timecoder_bank *b, size_t ns)
+{
+    unsigned int l;
+    size_t n;
+
+    for (l = 0; l < b->lanes; l += BANK_LANE_GROUP_AVX512) {
+        __m512i zero, thr, coeff;
+        __mmask16 pos;
+
+        zero = _mm512_loadu_si512(b->zero + l);
+        thr = _mm512_loadu_si512(b->threshold + l);
+        coeff = _mm512_loadu_si512(b->coeff + l);
+        pos = _mm512_test_epi32_mask(_mm512_loadu_si512(b->positive + l),
+                                     _mm512_set1_epi32(-1));
+
+        for (n = 0; n < ns; n++) {
+            __m512i v;
+            __mmask16 up, down;
+            unsigned int crossed, positive, k;
+
+            v = _mm512_loadu_si512(b->sample + n * b->lanes + l);
+            up = _mm512_mask_cmpgt_epi32_mask((__mmask16)~pos, v,
+                                              _mm512_add_epi32(zero, thr));
+            down = _mm512_mask_cmpgt_epi32_mask(pos,
+                                                _mm512_sub_epi32(zero, thr), v);
+
+            crossed = up | down;
+            pos ^= (__mmask16)crossed;
+            zero = zero_filter16(zero, v, coeff);
+
+            if (!crossed)
+                continue;
+
+            _mm512_storeu_si512(b->zero + l, zero);
+
+            for (k = l, positive = pos; crossed != 0;
+                 k += 2, crossed >>= 2, positive >>= 2)
+            {
+                if ((crossed & 3) == 0)
+                    continue;
+                bank_event(b, k / TIMECODER_CHANNELS, n, crossed & 3,
+                           positive & 3, b->zero[k]);
+            }
+        }
+
+        _mm512_storeu_si512(b->zero + l, zero);
+        _mm512_storeu_si512(b->positive + l, _mm512_maskz_set1_epi32(pos, -1));
+    }
+}
+
+#endif
+
+/*
+ * Detect the crossings and filter the zero of all lanes over ns rows
+ * with the kernel of the bank
+ */
+
+static void bank_scan(struct timecoder_bank *b, size_t ns)
+{
+    switch (b->kernel) {
+#ifdef X86
+    case TIMECODER_KERNEL_AVX512:
+        bank_scan_avx512(b, ns);
+        break;
+    case TIMECODER_KERNEL_AVX2:
+        bank_scan_avx2(b, ns);
+        break;
+#endif
+    default:
+        bank_scan_scalar(b, ns);
+        break;
+    }
+}
+
+/*
+ * Decode the crossings of one deck found by the scan of ns rows, from
+ * sample base of the block
+ */
+
+static void bank_crossings(struct timecoder_bank *b, unsigned int d,
+                           size_t base, size_t ns)
+{
+    struct timecoder *tc = &b->deck[d];
+    const struct timecoder_event *e = b->event + d * SCAN_BLOCK;
+    unsigned int k;
+    size_t last = 0;
+
+    for (k = 0; k < b->events[d]; k++, e++) {
+        if (tc->trace_position)
+            trace_idle(tc, base + last, e->n - last);
+        idle_samples(tc, e->n - last);
+
+        tc->primary.crossing_ticker++;
+        tc->secondary.crossing_ticker++;
+        tc->primary.swapped = e->swapped & 1;
+        tc->secondary.swapped = (e->swapped & 2) != 0;
+        if (tc->primary.swapped)
+            tc->primary.crossing_ticker = 0;
+        if (tc->secondary.swapped)
+            tc->secondary.crossing_ticker = 0;
+        tc->primary.positive = e->positive & 1;
+        tc->secondary.positive = (e->positive & 2) != 0;
+        tc->primary.zero = e->zero;
+
+        tc->at = base + e->n;
+        process_crossing<ANY_FLAGS, 0>(tc, e->primary);
+        tc->timecode_ticker++;
+
+        if (tc->trace_position)
+            trace_sample(tc, base + e->n);
+
+        last = e->n + 1;
+    }
+
+    if (tc->trace_position)
+        trace_idle(tc, base + last, ns - last);
+    idle_samples(tc, ns - last);
+}
+
+/*
+ * Decode a block for every deck of a bank: the decks are scanned for
+ * axis-crossings together, one channel per lane, and only the
+ * crossings are then decoded deck by deck
+ */
+
+static void bank_submit(struct timecoder_bank *b,
+                        const float *const *left,
+                        const float *const *right, size_t npcm)
+{
+    const float *primary[TIMECODER_BANK_DECKS], *secondary[TIMECODER_BANK_DECKS];
+    unsigned int d, l;
+    size_t base, ns;
+
+    for (d = 0; d < b->decks; d++) {
+        struct timecoder *tc = &b->deck[d];
+
+        l = d * TIMECODER_CHANNELS;
+
+        /* The monitor plots every sample, so the deck is decoded on
+         * its own and its lanes idle */
+
+        if (tc->mon) {
+            timecoder_submit_planar_float(tc, left[d], right[d], npcm);
+
+            primary[d] = secondary[d] = NULL;
+            b->zero[l] = b->zero[l + 1] = 0;
+            b->positive[l] = b->positive[l + 1] = 0;
+            b->threshold[l] = b->threshold[l + 1] = BANK_IDLE_THRESHOLD;
+            continue;
+        }
+
+        if (tc->def->flags & SWITCH_PRIMARY) {
+            primary[d] = left[d];
+            secondary[d] = right[d];
+        } else {
+            primary[d] = right[d];
+            secondary[d] = left[d];
+        }
+
+        b->zero[l] = tc->primary.zero;
+        b->zero[l + 1] = tc->secondary.zero;
+        b->positive[l] = -(signed int)tc->primary.positive;
+        b->positive[l + 1] = -(signed int)tc->secondary.positive;
+        b->threshold[l] = b->threshold[l + 1] = tc->threshold;
+        b->coeff[l] = b->coeff[l + 1] = tc->zero_coeff;
+    }
+
+    for (base = 0; base < npcm; base += ns) {
+        ns = npcm - base;
+        if (ns > SCAN_BLOCK)
+            ns = SCAN_BLOCK;
+
+        bank_load(b, primary, secondary, base, ns);
+
+        for (d = 0; d < b->decks; d++)
+            b->events[d] = 0;
+
+        bank_scan(b, ns);
+
+        for (d = 0; d < b->decks; d++) {
+            if (primary[d] != NULL)
+                bank_crossings(b, d, base, ns);
+        }
+    }
+
+    for (d = 0; d < b->decks; d++) {
+        struct timecoder *tc = &b->deck[d];
+
+        if (primary[d] == NULL)
+            continue;
+
+        l = d * TIMECODER_CHANNELS;
+        tc->primary.zero = b->zero[l];
+        tc->secondary.zero = b->zero[l + 1];
+        tc->primary.positive = b->positive[l] != 0;
+        tc->secondary.positive = b->positive[l + 1] != 0;
+    }
+}
+
+/*
+ * MODS Submit and decode a block of audio for every deck of a bank,
+ * given as one float buffer per channel of each deck
+ *
+ * If verifying, each deck is also decoded by the reference kernel on a
+ * copy, held by the bank from timecoder_bank_init().
+ */
+
+void timecoder_bank_submit(struct timecoder_bank *b,
+                           const float *const *left,
+                           const float *const *right, size_t npcm)
+{
+    struct timecoder *ref;
+    unsigned int d;
+
+    for (d = 0; d < b->decks; d++) {
+        b->deck[d].nbits = 0;
+        b->deck[d].bits_dropped = 0;
+    }
+
+    if (b->kernel == TIMECODER_KERNEL_REFERENCE) {
+        for (d = 0; d < b->decks; d++) {
+            planar_float in = { left[d], right[d] };
+
+            sample_kernel<planar_float, ANY_FLAGS, 0>(&b->deck[d], in, npcm);
+        }
+        return;
+    }
+
+    ref = NULL;
+    if (b->ref != NULL && kernel_verify.load(std::memory_order_relaxed)) {
+        ref = b->ref;
+        memcpy(ref, b->deck, sizeof *ref * b->decks);
+        for (d = 0; d < b->decks; d++) {
+            ref[d].trace_position = ref[d].trace_pitch = NULL;
+            ref[d].bits_size = 0;
+        }
+    }
+
+    bank_submit(b, left, right, npcm);
+
+    if (ref == NULL)
+        return;
+
+    for (d = 0; d < b->decks; d++) {
+        planar_float in = { left[d], right[d] };
+
+        if (ref[d].mon) /* decoded sample by sample already */
+            continue;
+
+        sample_kernel<planar_float, ANY_FLAGS, 0>(&ref[d], in, npcm);
+        verify(&b->deck[d], &ref[d]);
+    }
+}
+
+/*
+ * Get the last-known position of the timecode
+ *
+ * If now data is available or if too few bits have been error
+ * checked, then this counts as invalid. The last known position is
+ * given along with the time elapsed since the position stamp was
+ * read.
+ *
+ * Return: the known position of the timecode, or -1 if not known
+ * Post: if when != NULL, *when is the elapsed time in seconds
+ */
+
+signed int timecoder_get_position(struct timecoder *tc, double *when)
+{
+    signed int r;
+
+    // MODS or once the policy of the decoder has confirmed the position
+    if (!locked(tc))
+        return -1;
+
+    // MODS after the first lookup, process_bitstream() follows the
+    // position and the lookup table is left alone
+    if (tc->position == -1) {
+        r = lookup(tc->def, tc->bitstream);
+        if (r == -1)
+            return -1;
+        tc->position = r;
+    }
+
+    r = tc->position;
+    dassert(lookup(tc->def, tc->bitstream) == (unsigned)r);
 
     if (when)
         *when = tc->timecode_ticker * tc->dt;
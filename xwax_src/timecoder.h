@@ -44,6 +44,30 @@ struct timecode_def {
         safe; /* last 'safe' timecode number (for auto disconnect) */
     bool lookup; /* true if lut has been generated */
     struct lut lut;
+    unsigned int stride; /* MODS positions per lut slot, 1 unless sparse */
+    unsigned int users; /* MODS decoders holding the lut */
+    bool sparse; /* MODS copy of a definition with a sparse lut */
+};
+
+// MODS how lookup tables are built
+enum timecoder_lookup {
+    TIMECODER_LOOKUP_FULL, /* one slot per position */
+    TIMECODER_LOOKUP_SPARSE /* about sqrt(length) slots */
+};
+
+// MODS kernels decoding a block, in order of preference
+enum timecoder_kernel {
+    TIMECODER_KERNEL_AUTO, /* the best the processor supports */
+    TIMECODER_KERNEL_REFERENCE, /* sample by sample, as xwax */
+    TIMECODER_KERNEL_SCALAR, /* crossings found a block at a time */
+    TIMECODER_KERNEL_AVX2, /* and the bank scans eight lanes at once */
+    TIMECODER_KERNEL_AVX512 /* sixteen */
+};
+
+// MODS when a decoder first reports a position after a needle drop
+enum timecoder_lock {
+    TIMECODER_LOCK_BITS, /* after VALID_BITS error checks, as xwax */
+    TIMECODER_LOCK_ADJACENT /* as soon as successive lookups agree */
 };
 
 struct timecoder_channel {
@@ -53,6 +77,15 @@ struct timecoder_channel {
     unsigned int crossing_ticker; /* samples since we last crossed zero */
 };
 
+// MODS a bit read while the position is known, to follow the position
+// within a block
+
+struct timecoder_bit {
+    size_t offset; /* sample of the block the bit was read at */
+    signed int position; /* as timecoder_get_position() */
+    bool forwards;
+};
+
 struct timecoder {
     struct timecode_def *def;
     double speed;
@@ -60,6 +93,7 @@ struct timecoder {
     /* Precomputed values */
 
     double dt, zero_alpha;
+    unsigned int zero_coeff; /* MODS zero_alpha in Q32 fixed point */
     signed int threshold;
 
     /* Pitch information */
@@ -75,27 +109,106 @@ struct timecoder {
         timecode; /* corrected timecode */
     unsigned int valid_counter, /* number of successful error checks */
         timecode_ticker; /* samples since valid timecode was read */
+    signed int position; /* MODS of the bitstream once looked up, or -1 */
+    enum timecoder_lock lock; /* MODS */
+    signed int candidate; /* MODS last position looked up before a lock */
+    unsigned int lookups; /* MODS adjacent positions in a row, up to a lock */
+    bool tolerant; /* MODS */
+    unsigned int errors; /* MODS VALID_BITS per bit corrected, less one per bit */
 
     /* Feedback */
 
     unsigned char *mon; /* x-y array */
     int mon_size, mon_counter;
+    float *trace_position, *trace_pitch; /* MODS per sample, or NULL */
+    struct timecoder_bit *bits; /* MODS of the block submitted, or NULL */
+    size_t bits_size, nbits,
+        bits_dropped, /* MODS read past bits_size in the block */
+        at; /* MODS sample of the block being decoded */
+};
+
+// MODS what a decoder has learnt of its signal, to start another
+// decoder from, or the same one after a restart
+
+struct timecoder_calibration {
+    signed int ref_level;
+    signed int zero[TIMECODER_CHANNELS]; /* primary, secondary */
+    double pitch; /* of the filter, before speed */
+    signed int position; /* last known, or -1 */
 };
 
-struct timecode_def* timecoder_find_definition(const char *name);
+// MODS decoders for several decks, scanned for axis-crossings in
+// lockstep with one channel of one deck per lane
+
+#define TIMECODER_BANK_DECKS 16 /* at most, one bit per lane in a mask */
+
+struct timecoder_event;
+
+struct timecoder_bank {
+    unsigned int decks, lanes;
+    enum timecoder_kernel kernel; /* picked at init */
+    struct timecoder *deck;
+
+    /* Lanes 2d and 2d + 1 are the primary and secondary of deck d */
+
+    signed int *sample, /* SCAN_BLOCK rows of lanes */
+        *zero, *positive, /* positive is 0 or -1 */
+        *threshold;
+    unsigned int *coeff;
+
+    /* Crossings found by the scan, SCAN_BLOCK per deck at most */
+
+    struct timecoder_event *event;
+    unsigned int *events;
+
+    struct timecoder *ref; /* MODS decoded by the reference kernel, if verifying */
+};
+
+struct timecode_def* timecoder_find_definition(const char *name,
+                                               enum timecoder_lookup mode);
+void timecoder_release_definition(struct timecode_def *def);
+unsigned int timecoder_find_position(struct timecode_def *def, bits_t timecode);
 void timecoder_free_lookup(void);
+void timecoder_set_cache_dir(const char *dir);
+void timecoder_set_build_threads(int nthreads);
+void timecoder_set_kernel(enum timecoder_kernel kernel);
+enum timecoder_kernel timecoder_get_kernel(void);
+void timecoder_set_verify(bool verify);
+void timecoder_set_generic(bool generic);
+unsigned long timecoder_get_verify_failures(void);
 
 void timecoder_init(struct timecoder *tc, struct timecode_def *def,
                     double speed, unsigned int sample_rate, bool phono);
 void timecoder_clear(struct timecoder *tc);
+void timecoder_reconfigure(struct timecoder *tc, double speed,
+                           unsigned int sample_rate, bool phono);
+void timecoder_set_definition(struct timecoder *tc, struct timecode_def *def);
+void timecoder_set_lock(struct timecoder *tc, enum timecoder_lock lock);
+void timecoder_set_tolerant(struct timecoder *tc, bool tolerant);
+void timecoder_set_trace(struct timecoder *tc, float *position, float *pitch);
+void timecoder_set_bits(struct timecoder *tc, struct timecoder_bit *bits,
+                        size_t size);
+void timecoder_get_calibration(struct timecoder *tc,
+                               struct timecoder_calibration *c);
+void timecoder_set_calibration(struct timecoder *tc,
+                               const struct timecoder_calibration *c);
 
 int timecoder_monitor_init(struct timecoder *tc, int size);
 void timecoder_monitor_clear(struct timecoder *tc);
 
 void timecoder_cycle_definition(struct timecoder *tc);
 void timecoder_submit(struct timecoder *tc, signed short *pcm, size_t npcm);
+void timecoder_submit_planar_float(struct timecoder *tc,
+                                   const float *left, const float *right,
+                                   size_t npcm);
 signed int timecoder_get_position(struct timecoder *tc, double *when);
 
+int timecoder_bank_init(struct timecoder_bank *b, unsigned int decks);
+void timecoder_bank_clear(struct timecoder_bank *b);
+void timecoder_bank_submit(struct timecoder_bank *b,
+                           const float *const *left,
+                           const float *const *right, size_t npcm);
+
 /*
  * The timecode definition currently in use by this decoder
  */
@@ -105,6 +218,17 @@ static inline struct timecode_def* timecoder_get_definition(struct timecoder *tc
     return tc->def;
 }
 
+/*
+ * MODS The decoder of one deck of a bank, to be initialised with
+ * timecoder_init() before the bank is submitted audio
+ */
+
+static inline struct timecoder* timecoder_bank_deck(struct timecoder_bank *b,
+                                                    unsigned int d)
+{
+    return &b->deck[d];
+}
+
 /*
  * Return the pitch relative to reference playback speed
  */
@@ -114,6 +238,26 @@ static inline double timecoder_get_pitch(struct timecoder *tc)
     return pitch_current(&tc->pitch) / tc->speed;
 }
 
+/*
+ * MODS The number of bits written by the last block submitted to the
+ * array given to timecoder_set_bits()
+ */
+
+static inline size_t timecoder_get_bits(struct timecoder *tc)
+{
+    return tc->nbits;
+}
+
+/*
+ * MODS The number of bits read by the last block submitted which did
+ * not fit in the array given to timecoder_set_bits()
+ */
+
+static inline size_t timecoder_get_bits_dropped(struct timecoder *tc)
+{
+    return tc->bits_dropped;
+}
+
 /*
  * The last 'safe' timecode value on the record. Beyond this value, we
  * probably want to ignore the timecode values, as we will hit the
@@ -145,4 +289,22 @@ static inline double timecoder_revs_per_sec(struct timecoder *tc)
     return (33.0 + 1.0 / 3) * tc->speed / 60;
 }
 
+/*
+ * MODS Position and pitch of one deck of a bank, as
+ * timecoder_get_position() and timecoder_get_pitch()
+ */
+
+static inline signed int timecoder_bank_get_position(struct timecoder_bank *b,
+                                                     unsigned int d,
+                                                     double *when)
+{
+    return timecoder_get_position(timecoder_bank_deck(b, d), when);
+}
+
+static inline double timecoder_bank_get_pitch(struct timecoder_bank *b,
+                                              unsigned int d)
+{
+    return timecoder_get_pitch(timecoder_bank_deck(b, d));
+}
+
 #endif